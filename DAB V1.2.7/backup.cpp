@@ -1,4 +1,8 @@
 #include "backup.h"
+#include "copyengine.h"
+#include "manifest.h"
+#include "trace.h"
+#include "patharena.h"
 #include <filesystem>
 #include <fstream>
 #include <chrono>
@@ -8,32 +12,114 @@
 #include <algorithm>
 #include <codecvt>
 #include <processthreadsapi.h>
+#include <ctime>
 
-BackupManager::BackupManager() : watching(false), hDir(INVALID_HANDLE_VALUE), pollingMode(false), pollingInterval(3000) {}
+BackupManager::BackupManager() : watching(false), hDir(INVALID_HANDLE_VALUE), pollingMode(false), pollingInterval(3000),
+    logger(std::make_shared<AsyncLogger>(L"backup.log")),
+    pruner(std::make_shared<PruneWorker>([this](const std::wstring& msg) { log(msg); })) {
+    stopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+}
+
+BackupManager::BackupManager(std::shared_ptr<AsyncLogger> sharedLogger, std::shared_ptr<PruneWorker> sharedPruner,
+                             const std::wstring& tag)
+    : watching(false), hDir(INVALID_HANDLE_VALUE), pollingMode(false), pollingInterval(3000),
+      logTag(tag.empty() ? std::wstring() : L"[" + tag + L"] "),
+      logger(std::move(sharedLogger)), pruner(std::move(sharedPruner)) {
+    stopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    loadLimits.enabled = false;
+    loadGate.setLimits(loadLimits);
+}
 
 BackupManager::~BackupManager() {
+    cancelBackup();
+    if (backupThread.joinable()) backupThread.join();
     stopWatching();
+    if (stopEvent) CloseHandle(stopEvent);
 }
 
 void BackupManager::setMaxBackupCount(int count) {
     maxBackupCount = count;
 }
 
+void BackupManager::setRetentionPolicy(const RetentionPolicy& policy) {
+    retentionPolicy = policy;
+}
+
+void BackupManager::setQuotaMB(int megabytes) {
+    quotaMB = megabytes;
+}
+
+void BackupManager::setLogLevel(LogLevel level) {
+    logLevel = level;
+    logger->setLevel(level);
+}
+
+void BackupManager::setLogRotation(const LogRotation& rotation) {
+    logRotation = rotation;
+    logger->setRotation(rotation);
+}
+
+void BackupManager::setTraceEnabled(bool enabled) {
+    traceEnabled = enabled;
+    TraceEnable(enabled);
+}
+
+bool BackupManager::dumpTrace() {
+    if (!TraceEnabled()) return false;
+    if (!TraceDump(TRACE_FILE_NAME)) {
+        log(L"[警告] 写入跟踪文件失败", LogLevel::Warning);
+        return false;
+    }
+    return true;
+}
+
+void BackupManager::setMetricsFile(const std::wstring& path) {
+    metricsFile = path;
+}
+
+void BackupManager::setLowPriority(bool enabled) {
+    lowPriority = enabled;
+}
+
+void BackupManager::setLoadLimits(const LoadLimits& limits) {
+    loadLimits = limits;
+    loadGate.setLimits(limits);
+}
+
+void BackupManager::setCommitCallback(CommitCallback callback) {
+    onCommit = std::move(callback);
+}
+
 void BackupManager::setWatchFile(const std::wstring& fullPath) {
+    std::lock_guard<std::mutex> lk(queueMtx);
+    if (watching.load()) {
+        // 监听线程一直在读源路径，改动要到重新开始监听时才生效
+        if (fullPath != watchFilePath) log(L"[监听] 监听进行中，忽略源路径的修改: " + fullPath, LogLevel::Warning);
+        return;
+    }
     watchFilePath = fullPath;
     watchDir = std::filesystem::path(fullPath).parent_path().wstring();
     watchFileName = std::filesystem::path(fullPath).filename().wstring();
 }
 
 void BackupManager::addBackupTarget(const std::wstring& targetDir) {
+    std::lock_guard<std::mutex> lk(queueMtx);
     backupTargets.push_back(targetDir);
 }
 
 void BackupManager::clearBackupTargets() {
+    std::lock_guard<std::mutex> lk(queueMtx);
     backupTargets.clear();
 }
 
+void BackupManager::setBackupTargets(const std::vector<std::wstring>& targets) {
+    std::lock_guard<std::mutex> lk(queueMtx);
+    backupTargets = targets;
+}
+
 void BackupManager::setPollingMode(bool enabled) {
+    std::lock_guard<std::mutex> lk(queueMtx);
+    if (watching.load()) return;  // 监听方式在开始监听时就定了
     pollingMode = enabled;
 }
 
@@ -42,6 +128,7 @@ void BackupManager::setPollingInterval(int ms) {
 }
 
 void BackupManager::setIncrementalMode(bool enabled) {
+    std::lock_guard<std::mutex> lk(queueMtx);
     incrementalMode = enabled;
 }
 
@@ -50,42 +137,61 @@ bool BackupManager::startWatching() {
     if (watchFilePath.empty() || backupTargets.empty()) return false;
 
     lastFolderSnapshot.clear();
+    lastFileWrite = {};
+    retentionIndex.clear();  // 每次开始监听时重新与磁盘同步一次
+    ResetEvent(stopEvent);
     watching = true;
 
-    watchThread = std::make_unique<std::thread>(&BackupManager::watchLoop, this);
+    watchThread = std::make_unique<std::thread>([this]() {
+        // 记下监听线程，在它上面执行的备份由 stopWatching 取消；退出时清除，线程 id 之后可能被别的线程复用
+        {
+            std::lock_guard<std::mutex> lk(cancelMtx);
+            watchThreadId = std::this_thread::get_id();
+        }
+        watchLoop();
+        std::lock_guard<std::mutex> lk(cancelMtx);
+        watchThreadId = std::thread::id();
+    });
     return true;
 }
 
 void BackupManager::stopWatching() {
     if (!watching.load()) return;
 
-    watching = false;
+    const uint64_t stopStart = MetricsNowMicros();
+    {
+        // 监听线程正在备份时让它在当前文件（大文件为当前数据块）之后中止
+        std::lock_guard<std::mutex> lk(cancelMtx);
+        watching = false;
+        if (runOwner == RunOwner::Watcher) runCancel = true;
+    }
 
-    // 唤醒轮询线程（如果在 sleep 中）
+    // 唤醒轮询线程（如果在 sleep 中）和事件监听线程（和目录通知一起等着这个事件）
     cv.notify_all();
+    SetEvent(stopEvent);
+    {
+        // 因负载推迟、还在等待的备份按停止处理
+        std::lock_guard<std::mutex> lk(queueMtx);
+        queueCv.notify_all();
+    }
 
     if (watchThread && watchThread->joinable()) {
-        if (!pollingMode && hDir != INVALID_HANDLE_VALUE) {
-            // 普通监听模式下，打断 ReadDirectoryChangesW 阻塞
-            auto nativeHandle = watchThread->native_handle(); // uintptr_t 类型
-            DWORD threadId = GetThreadId(reinterpret_cast<HANDLE>(nativeHandle));
-            if (threadId != 0) {
-                HANDLE hThread = OpenThread(THREAD_ALL_ACCESS, FALSE, threadId);
-                if (hThread) {
-                    CancelSynchronousIo(hThread); // 中断 ReadDirectoryChangesW
-                    CloseHandle(hThread);
-                }
-            }
-        }
-
         watchThread->join();
         watchThread.reset();
     }
 
+    const uint64_t stopMicros = MetricsNowMicros() - stopStart;
+    metrics.stopLatency.record(stopMicros);
+    log(L"[监听] 监听线程已退出，停止耗时 " + std::to_wstring(stopMicros / 1000) + L" ms",
+        stopMicros > 1000000 ? LogLevel::Warning : LogLevel::Debug);
+    dumpTrace();
+
     if (hDir != INVALID_HANDLE_VALUE) {
         CloseHandle(hDir);
         hDir = INVALID_HANDLE_VALUE;
     }
+
+    logger->flush();  // 停止后立即可以查看完整的日志
 }
 
 bool BackupManager::isWatching() const {
@@ -98,189 +204,663 @@ static std::wstring GetFileNameFromPath(const std::wstring& path) {
     return path.substr(pos + 1);
 }
 
-static bool CopyDirectoryRecursive(const std::wstring& srcDir, const std::wstring& dstDir) {
-    if (!CreateDirectoryW(dstDir.c_str(), NULL)) {
+// 统计源路径下的文件数和总字节数，用于估计备份进度
+// dir 在整个遍历中复用，见 CopyDirectoryRecursive
+static void MeasureTree(PathBuffer& dir, unsigned long long& files, unsigned long long& bytes) {
+    const size_t len = dir.push(L"*");
+    WIN32_FIND_DATAW ffd;
+    HANDLE hFind = FindFirstFileExW(dir.c_str(), FindExInfoBasic, &ffd, FindExSearchNameMatch, NULL,
+                                    FIND_FIRST_EX_LARGE_FETCH);
+    dir.truncate(len);
+    if (hFind == INVALID_HANDLE_VALUE) return;
+    do {
+        const wchar_t* name = ffd.cFileName;
+        if (wcscmp(name, L".") == 0 || wcscmp(name, L"..") == 0) continue;
+        if (ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            dir.push(name);
+            MeasureTree(dir, files, bytes);
+            dir.truncate(len);
+        } else {
+            ++files;
+            bytes += ((unsigned long long)ffd.nFileSizeHigh << 32) | ffd.nFileSizeLow;
+        }
+    } while (FindNextFileW(hFind, &ffd) != 0);
+    FindClose(hFind);
+}
+
+static void MeasureSource(const std::wstring& path, unsigned long long& files, unsigned long long& bytes) {
+    WIN32_FIND_DATAW ffd;
+    HANDLE hFind = FindFirstFileExW(path.c_str(), FindExInfoBasic, &ffd, FindExSearchNameMatch, NULL, 0);
+    if (hFind == INVALID_HANDLE_VALUE) return;
+    FindClose(hFind);
+    if (!(ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+        ++files;
+        bytes += ((unsigned long long)ffd.nFileSizeHigh << 32) | ffd.nFileSizeLow;
+        return;
+    }
+
+    PathBuffer dir;
+    dir.assign(path);
+    MeasureTree(dir, files, bytes);
+}
+
+void BackupProgress::reset() {
+    filesDone = 0;
+    filesTotal = 0;
+    bytesDone = 0;
+    bytesTotal = 0;
+    startedAt = MetricsNowMicros();
+}
+
+double BackupProgress::fraction() const {
+    unsigned long long total = bytesTotal.load();
+    unsigned long long done = bytesDone.load();
+    if (total == 0) {
+        total = filesTotal.load();
+        done = filesDone.load();
+    }
+    if (total == 0) return 0;
+    return std::min(1.0, (double)done / (double)total);
+}
+
+double BackupProgress::etaSeconds() const {
+    double done = fraction();
+    uint64_t start = startedAt.load();
+    if (done <= 0 || start == 0) return -1;
+    double elapsed = (MetricsNowMicros() - start) / 1e6;
+    if (elapsed < 0.5) return -1;  // 刚开始时速度还不稳定
+    return elapsed * (1 - done) / done;
+}
+
+// src、dst 在整个遍历中复用：进入一项时追加 "\名字"，处理完截回原长度，逐个文件不再拼新的路径字符串
+static bool CopyDirectoryRecursive(PathBuffer& src, PathBuffer& dst, const std::wstring& stagingDir,
+                                   DurabilityBatch& batch, RunStats& stats, const std::atomic<bool>& cancel,
+                                   BackupProgress& progress) {
+    if (!CreateDirectoryW(dst.c_str(), NULL)) {
         if (GetLastError() != ERROR_ALREADY_EXISTS) {
             return false;
         }
     }
 
+    const size_t srcLen = src.push(L"*");
     WIN32_FIND_DATAW ffd;
-    std::wstring searchPath = srcDir + L"\\*";
-    HANDLE hFind = FindFirstFileW(searchPath.c_str(), &ffd);
+    HANDLE hFind = FindFirstFileW(src.c_str(), &ffd);
+    src.truncate(srcLen);
     if (hFind == INVALID_HANDLE_VALUE) return false;
 
+    bool ok = true;
     do {
-        const std::wstring name = ffd.cFileName;
-        if (name == L"." || name == L"..") continue;
+        const wchar_t* name = ffd.cFileName;
+        if (wcscmp(name, L".") == 0 || wcscmp(name, L"..") == 0) continue;
+        if (cancel.load(std::memory_order_relaxed)) {
+            ok = false;
+            break;
+        }
 
-        std::wstring srcPath = srcDir + L"\\" + name;
-        std::wstring dstPath = dstDir + L"\\" + name;
+        src.push(name);
+        const size_t dstLen = dst.push(name);
 
         if (ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
-            if (!CopyDirectoryRecursive(srcPath, dstPath)) {
-                FindClose(hFind);
-                return false;
-            }
+            ok = CopyDirectoryRecursive(src, dst, stagingDir, batch, stats, cancel, progress);
         }
         else {
-            if (!CopyFileW(srcPath.c_str(), dstPath.c_str(), FALSE)) {
-                FindClose(hFind);
-                return false;
+            ++stats.scanned;
+            CopyResult result;
+            result.cancel = &cancel;
+            result.progressBytes = &progress.bytesDone;
+            ok = BackupCopyFile(src.str(), dst.str(), stagingDir, &batch, &result);
+            ++progress.filesDone;
+            if (!ok) {
+                if (!cancel.load()) ++stats.failed;
+            } else {
+                ++stats.copied;
+                stats.bytes += result.bytes;
+                if (result.resumedFrom > 0) ++stats.resumed;
             }
         }
-    } while (FindNextFileW(hFind, &ffd) != 0);
+
+        src.truncate(srcLen);
+        dst.truncate(dstLen);
+    } while (ok && FindNextFileW(hFind, &ffd) != 0);
 
     FindClose(hFind);
-    return true;
+    return ok;
 }
 
 void BackupManager::backupFile() {
+    requestRun(0, true);
+}
+
+bool BackupManager::requestRun(uint64_t detectedAt, bool wait) {
+    std::unique_lock<std::mutex> lk(queueMtx);
+    const uint64_t ticket = ++requestSeq;
+    if (detectedAt == 0) pendingUrgent = true;  // 手动请求没有发现变化的时间
+    if (detectedAt != 0 && (pendingDetectedAt == 0 || detectedAt < pendingDetectedAt)) {
+        pendingDetectedAt = detectedAt;  // 合并后按最早一次变化计算延迟
+    }
+
+    if (runnerActive) {
+        if (logger->enabled(LogLevel::Debug)) {
+            log(L"[队列] 备份进行中，本次请求合并到结束后的下一次备份", LogLevel::Debug);
+        }
+        if (pendingUrgent) queueCv.notify_all();  // 正在因负载推迟的话立即开始
+        if (!wait) return false;
+        queueCv.wait(lk, [&]() { return completedSeq >= ticket; });
+        return lastRunCancelled;
+    }
+
+    // 由调用线程执行；执行期间到达的请求都合并成结束后的一次
+    runnerActive = true;
+    bool firstCancelled = false;
+    for (bool first = true; completedSeq < requestSeq; first = false) {
+        if (!pendingUrgent) deferWhileBusy(lk);
+        const uint64_t covers = requestSeq;
+        const uint64_t runDetectedAt = pendingDetectedAt;
+        pendingDetectedAt = 0;
+        pendingUrgent = false;
+        // 本次备份用的源路径和目标在这里定下，执行期间界面或守护进程修改设置只影响下一次
+        runSource = watchFilePath;
+        runTargets = backupTargets;
+        runIncremental = incrementalMode;
+        lk.unlock();
+
+        changeDetectedAt = runDetectedAt;
+        bool wasCancelled = runBackup();
+        changeDetectedAt = 0;
+        if (runDetectedAt != 0 && !wasCancelled) {
+            metrics.changeToBackup.record(MetricsNowMicros() - runDetectedAt);
+        }
+        if (first) firstCancelled = wasCancelled;
+
+        lk.lock();
+        completedSeq = covers;
+        lastRunCancelled = wasCancelled;
+        queueCv.notify_all();
+    }
+    runnerActive = false;
+    return firstCancelled;
+}
+
+void BackupManager::deferWhileBusy(std::unique_lock<std::mutex>& lk) {
+    std::wstring reason;
+    if (!loadGate.busy(&reason)) return;
+
+    const LoadLimits limits = loadGate.limits();
+    const uint64_t start = MetricsNowMicros();
+    const uint64_t maxDefer = (uint64_t)std::max(0, limits.maxDeferSeconds) * 1000000;
+    metrics.backupsDeferred.add();
+    log(L"[负载] 系统繁忙（" + reason + L"），推迟备份，最多 " + std::to_wstring(limits.maxDeferSeconds) + L" 秒");
+
+    const bool onWatcher = onWatchThread();
+    auto stopped = [&]() { return aborted.load() || (onWatcher && !watching.load()); };
+    std::wstring outcome = L"负载已下降";
+    for (;;) {
+        queueCv.wait_for(lk, std::chrono::seconds(LOAD_RECHECK_SECONDS), [&]() { return pendingUrgent || stopped(); });
+        if (pendingUrgent) {
+            outcome = L"有手动备份请求";
+            break;
+        }
+        if (stopped()) {
+            outcome = L"监听已停止";
+            break;
+        }
+        if (MetricsNowMicros() - start >= maxDefer) {
+            outcome = L"已达最长推迟时间，不再等待";
+            break;
+        }
+        if (!loadGate.busy(nullptr)) break;
+    }
+
+    const uint64_t waited = MetricsNowMicros() - start;
+    metrics.deferDuration.record(waited);
+    log(L"[负载] " + outcome + L"，共推迟 " + std::to_wstring(waited / 1000000) + L" 秒");
+}
+
+bool BackupManager::onWatchThread() {
+    std::lock_guard<std::mutex> lk(cancelMtx);
+    return std::this_thread::get_id() == watchThreadId;
+}
+
+bool BackupManager::runBackup() {
+    {
+        // 在监听线程上执行的备份归监听所有，停止监听时取消（即使合并进了手动请求，否则停止监听要等它拷完）。
+        // 开始前就已经请求了取消（停止监听、取消手动备份）的，这次直接跳过所有目标
+        std::lock_guard<std::mutex> lk(cancelMtx);
+        const bool onWatcher = std::this_thread::get_id() == watchThreadId;
+        runOwner = onWatcher ? RunOwner::Watcher : RunOwner::Other;
+        runCancel = aborted.load() || (onWatcher ? !watching.load() : cancelRequested.load());
+    }
+
+    // 后台模式同时降低 CPU 与磁盘 I/O 优先级，只在本次备份期间有效：
+    // 执行备份的若是监听线程，回去等待目录通知时仍是正常优先级
+    bool background = lowPriority && SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+    copyToTargets();
+    if (background) SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_END);
+
+    std::lock_guard<std::mutex> lk(cancelMtx);
+    runOwner = RunOwner::None;
+    bool wasCancelled = runCancel.load();
+    if (wasCancelled) metrics.backupsCancelled.add();
+    return wasCancelled;
+}
+
+void BackupManager::copyToTargets() {
+    metrics.backupsTriggered.add();
+    const uint64_t detectedAt = changeDetectedAt.load();
+    // 每次备份都重新估计总量（不论由谁发起），不能沿用上一次手动备份的数字
+    runProgress.reset();
     try {
         auto timestamp = getTimestamp();
-        std::filesystem::path srcPath(watchFilePath);
+        long long backupTime = (long long)std::time(nullptr);
+        std::filesystem::path srcPath(runSource);
 
-        DWORD attr = GetFileAttributesW(watchFilePath.c_str());
+        DWORD attr = GetFileAttributesW(runSource.c_str());
         if (attr == INVALID_FILE_ATTRIBUTES) {
-            log(L"[错误] 源路径无效或不存在: " + watchFilePath);
+            log(L"[错误] 源路径无效或不存在: " + runSource, LogLevel::Error);
             return;
         }
 
-        std::wstring baseName = GetFileNameFromPath(watchFilePath);
+        // 先估计总量，界面和守护进程的 status 才能显示这次备份的百分比和剩余时间
+        unsigned long long files = 0, bytes = 0;
+        MeasureSource(runSource, files, bytes);
+        runProgress.filesTotal = files * runTargets.size();
+        runProgress.bytesTotal = bytes * runTargets.size();
+        runProgress.startedAt = MetricsNowMicros();  // 剩余时间按拷贝的速度估计，不算遍历的时间
+
+        std::wstring baseName = GetFileNameFromPath(runSource);
         std::wstring backupSubfolderName = baseName + L" Backup";
+        PathArena runArena;  // 本次备份驻留的目录路径，备份结束时一起释放
 
-        for (const auto& targetDir : backupTargets) {
+        for (const auto& targetDir : runTargets) {
+            if (cancelled()) {
+                log(L"[取消] 备份已取消，跳过目标: " + targetDir, LogLevel::Warning);
+                continue;
+            }
             std::filesystem::path backupFolder = std::filesystem::path(targetDir) / backupSubfolderName;
             std::filesystem::create_directories(backupFolder);
+            std::wstring stagingDir = (backupFolder / STAGING_DIR_NAME).wstring();
+            DurabilityBatch batch;  // 本目标的所有拷贝在最后统一落盘一次
+            RunStats stats;
+            auto runStart = std::chrono::steady_clock::now();
+            TraceSpan runSpan(TraceEvent::Run, targetDir);
 
-            if (incrementalMode) {
+            if (runIncremental) {
                 // -------------------- 增量备份模式 --------------------
-                if (attr & FILE_ATTRIBUTE_DIRECTORY) {
-                    for (auto& entry : std::filesystem::recursive_directory_iterator(srcPath)) {
-                        if (!std::filesystem::is_regular_file(entry)) continue;
-
-                        auto relPath = std::filesystem::relative(entry.path(), srcPath);
-                        std::filesystem::path destFile = backupFolder / relPath;
-
-                        std::error_code ec;
-                        std::filesystem::create_directories(destFile.parent_path(), ec);
-
-                        bool needCopy = true;
-                        if (std::filesystem::exists(destFile)) {
-                            auto srcTime = std::filesystem::last_write_time(entry.path());
-                            auto dstTime = std::filesystem::last_write_time(destFile);
-                            auto srcSize = std::filesystem::file_size(entry.path(), ec);
-                            auto dstSize = std::filesystem::file_size(destFile, ec);
-
-                            if (srcTime == dstTime && srcSize == dstSize) {
-                                needCopy = false;
-                                log(L"[增量备份] 跳过未修改文件: " + destFile.wstring());
-                            }
-                        }
+                // 只拿源文件和清单比较，不再逐个访问目标盘上的文件
+                std::wstring manifestPath = (backupFolder / MANIFEST_FILE_NAME).wstring();
+                BackupManifest manifest;
+                PathInterner createdDirs(runArena);
+                bool haveManifest = manifest.load(manifestPath);
+                if (!haveManifest) {
+                    log(L"[增量备份] 未找到备份清单，本次将比较目标文件: " + manifestPath);
+                }
 
-                        if (needCopy) {
-                            std::filesystem::copy_file(entry.path(), destFile,
-                                std::filesystem::copy_options::overwrite_existing, ec);
-                            if (!ec) {
-                                log(L"[增量备份] 更新文件: " + destFile.wstring());
+                {
+                    TraceSpan phase(TraceEvent::PhaseScan);
+                    if (attr & FILE_ATTRIBUTE_DIRECTORY) {
+                        // 目录遍历的耗时记在遍历到的那个文件上（中间跳过的目录也算在内）
+                        uint64_t enumStart = TraceEnabled() ? TraceNow() : 0;
+
+                        // 迭代器给出的路径都以源路径开头，相对路径直接截取，不再逐个调用 relative()；
+                        // 相对路径和目标路径都写在复用的缓冲里，逐个文件不再分配路径字符串
+                        const std::wstring& srcRoot = srcPath.native();
+                        const bool rootEndsWithSep = !srcRoot.empty() && (srcRoot.back() == L'\\' || srcRoot.back() == L'/');
+                        const size_t relStart = srcRoot.size() + (rootEndsWithSep ? 0 : 1);
+                        std::wstring relPath;
+                        relPath.reserve(512);
+                        PathBuffer destFile;
+                        destFile.assign(backupFolder.wstring());
+                        const size_t destRootLen = destFile.size();
+
+                        for (auto& entry : std::filesystem::recursive_directory_iterator(srcPath)) {
+                            if (cancelled()) break;
+                            if (!entry.is_regular_file()) continue;
+                            if (enumStart) TraceAdd(TraceEvent::Enumerate, enumStart, TraceName(entry.path().native()));
+
+                            const std::wstring& full = entry.path().native();
+                            if (full.size() > relStart && full.compare(0, srcRoot.size(), srcRoot) == 0) {
+                                relPath.assign(full, relStart, std::wstring::npos);
                             } else {
-                                log(L"[增量备份] 拷贝失败: " + destFile.wstring());
+                                relPath = std::filesystem::relative(entry.path(), srcPath).wstring();
                             }
+                            destFile.truncate(destRootLen);
+                            destFile.push(relPath);
+                            incrementalCopy(entry, relPath, destFile.str(), manifest, haveManifest, stagingDir, batch,
+                                            createdDirs, stats);
+                            if (enumStart) enumStart = TraceNow();
                         }
+                    } else {
+                        // 单文件增量备份
+                        incrementalCopy(std::filesystem::directory_entry(srcPath), srcPath.filename().wstring(),
+                                        (backupFolder / srcPath.filename()).wstring(), manifest, haveManifest,
+                                        stagingDir, batch, createdDirs, stats);
                     }
-                } else {
-                    // 单文件增量备份
-                    std::filesystem::path destFile = backupFolder / srcPath.filename();
-
-                    std::error_code ec;
-                    bool needCopy = true;
-                    if (std::filesystem::exists(destFile)) {
-                        auto srcTime = std::filesystem::last_write_time(srcPath);
-                        auto dstTime = std::filesystem::last_write_time(destFile);
-                        auto srcSize = std::filesystem::file_size(srcPath, ec);
-                        auto dstSize = std::filesystem::file_size(destFile, ec);
-
-                        if (srcTime == dstTime && srcSize == dstSize) {
-                            needCopy = false;
-                            log(L"[增量备份] 跳过未修改文件: " + destFile.wstring());
-                        }
-                    }
+                }
+                if (cancelled()) {
+                    // 已拷贝完的文件照常落盘并记入清单，下次只需补上剩下的
+                    log(L"[取消] 增量备份已取消: " + targetDir, LogLevel::Warning);
+                }
 
-                    if (needCopy) {
-                        std::filesystem::copy_file(srcPath, destFile,
-                            std::filesystem::copy_options::overwrite_existing, ec);
-                        if (!ec) {
-                            log(L"[增量备份] 更新文件: " + destFile.wstring());
-                        } else {
-                            log(L"[增量备份] 拷贝失败: " + destFile.wstring());
-                        }
+                bool committed;
+                {
+                    TraceSpan phase(TraceEvent::PhaseCommit);
+                    committed = batch.commit();
+                    if (committed) {
+                        if (!cancelled()) recordCommit(targetDir, detectedAt);
+                    } else {
+                        log(L"[警告] 备份数据刷盘失败: " + targetDir, LogLevel::Warning);
                     }
                 }
 
+                // 清单在数据落盘之后再保存，保证清单里记录的文件都已完整写入；
+                // 刷盘失败时不保存，沿用旧清单，下次把这些文件当作有变化重新拷贝。
+                // 只有完整走完、没有失败的遍历才能据此删掉源路径上已不存在的条目；
+                // 取消或有文件失败时，没走到的条目原样保留，下次只补上剩下的
+                TraceSpan phase(TraceEvent::PhaseMetadata);
+                const bool walkComplete = !cancelled() && stats.failed == 0;
+                if (committed && manifest.dirty() && !manifest.save(manifestPath, walkComplete)) {
+                    log(L"[警告] 保存备份清单失败: " + manifestPath, LogLevel::Warning);
+                }
+
             } else {
                 // -------------------- 普通完整备份模式 --------------------
-                if (attr & FILE_ATTRIBUTE_DIRECTORY) {
-                    std::filesystem::path destFolder = backupFolder / (baseName + L"_" + timestamp);
-                    if (CopyDirectoryRecursive(watchFilePath, destFolder.wstring())) {
-                        log(L"[备份成功] 文件夹 " + watchFilePath + L" -> " + destFolder.wstring());
-                    } else {
-                        log(L"[错误] 文件夹备份失败: " + watchFilePath + L" -> " + destFolder.wstring());
+                // 只在第一次使用时列目录，之后维护索引；配额要在拷贝之前腾出空间
+                RetentionIndex& index = retentionIndex[backupFolder.wstring()];
+                if (!index.loaded()) {
+                    std::vector<std::wstring> leftovers;
+                    index.load(backupFolder.wstring(), &leftovers);
+                    for (const auto& path : leftovers) {
+                        if (logger->enabled(LogLevel::Debug)) {
+                            log(L"[清理] 删除中断拷贝留下的临时文件: " + path, LogLevel::Debug);
+                        }
+                        pruner->enqueue(path);
                     }
-                } else {
-                    std::wstring backupFileName = srcPath.stem().wstring() + L"_" + timestamp + srcPath.extension().wstring();
-                    std::filesystem::path destPath = backupFolder / backupFileName;
-                    std::filesystem::copy_file(srcPath, destPath, std::filesystem::copy_options::overwrite_existing);
-                    log(L"[备份成功] 文件 " + destPath.wstring());
+                }
+                if (quotaMB > 0) {
+                    enforceQuota(index, backupFolder);
                 }
 
-                // 控制备份数量
-                std::vector<std::filesystem::directory_entry> entries;
-                for (const auto& entry : std::filesystem::directory_iterator(backupFolder)) {
-                    if (entry.is_regular_file() || entry.is_directory()) {
-                        entries.push_back(entry);
+                BackupVersion version;
+                version.time = backupTime;
+                bool created = false;
+
+                {
+                    TraceSpan phase(TraceEvent::PhaseCopy);
+                    if (attr & FILE_ATTRIBUTE_DIRECTORY) {
+                        version.name = baseName + L"_" + timestamp;
+                        version.isDirectory = true;
+                        std::filesystem::path destFolder = backupFolder / version.name;
+                        PathBuffer srcBuf, dstBuf;
+                        srcBuf.assign(runSource);
+                        dstBuf.assign(destFolder.wstring());
+                        if (CopyDirectoryRecursive(srcBuf, dstBuf, stagingDir, batch, stats, runCancel, runProgress)) {
+                            log(L"[备份成功] 文件夹 " + runSource + L" -> " + destFolder.wstring());
+                        } else if (cancelled()) {
+                            log(L"[取消] 文件夹备份已取消: " + destFolder.wstring(), LogLevel::Warning);
+                        } else {
+                            log(L"[错误] 文件夹备份失败: " + runSource + L" -> " + destFolder.wstring(), LogLevel::Error);
+                        }
+                        version.bytes = stats.bytes;
+                        if (cancelled()) {
+                            // 取消的版本不完整，不纳入索引，整个文件夹交给清理线程删除，不拖慢停止
+                            pruner->enqueue(destFolder.wstring());
+                        } else {
+                            // 失败时可能留下不完整的文件夹，同样纳入索引以便日后清理
+                            created = GetFileAttributesW(destFolder.wstring().c_str()) != INVALID_FILE_ATTRIBUTES;
+                        }
+                    } else {
+                        version.name = srcPath.stem().wstring() + L"_" + timestamp + srcPath.extension().wstring();
+                        std::filesystem::path destPath = backupFolder / version.name;
+                        CopyResult result;
+                        result.cancel = &runCancel;
+                        result.progressBytes = &runProgress.bytesDone;
+                        ++stats.scanned;
+                        bool copied = BackupCopyFile(runSource, destPath.wstring(), stagingDir, &batch, &result);
+                        ++runProgress.filesDone;
+                        if (copied) {
+                            if (result.resumedFrom > 0) {
+                                log(L"[续传] 从 " + std::to_wstring(result.resumedFrom) + L" 字节处继续拷贝: " + destPath.wstring());
+                                ++stats.resumed;
+                            }
+                            log(L"[备份成功] 文件 " + destPath.wstring());
+                            ++stats.copied;
+                            stats.bytes += result.bytes;
+                            version.bytes = result.bytes;
+                            created = true;
+                        } else if (cancelled()) {
+                            log(L"[取消] 文件备份已取消: " + destPath.wstring(), LogLevel::Warning);
+                        } else {
+                            ++stats.failed;
+                            log(L"[错误] 文件备份失败: " + runSource + L" -> " + destPath.wstring(), LogLevel::Error);
+                        }
                     }
                 }
 
-                std::sort(entries.begin(), entries.end(),
-                          [](const std::filesystem::directory_entry& a, const std::filesystem::directory_entry& b) {
-                              return a.last_write_time() < b.last_write_time();
-                          });
-
-                while ((int)entries.size() > maxBackupCount) {
-                    try {
-                        const auto& oldest = entries.front();
-                        std::filesystem::remove_all(oldest);
-                        log(L"[清理] 删除旧备份: " + oldest.path().wstring());
-                        entries.erase(entries.begin());
-                    } catch (...) {
-                        log(L"[警告] 删除旧备份失败: " + entries.front().path().wstring());
-                        entries.erase(entries.begin());
+                {
+                    TraceSpan phase(TraceEvent::PhaseCommit);
+                    if (!batch.commit()) {
+                        log(L"[警告] 备份数据刷盘失败: " + targetDir, LogLevel::Warning);
+                    } else if (created) {
+                        recordCommit(targetDir, detectedAt);
                     }
                 }
+
+                // 控制备份数量，删除交给后台线程
+                TraceSpan phase(TraceEvent::PhaseMetadata);
+                if (created) {
+                    index.add(version);
+                }
+
+                auto expired = retentionPolicy.enabled()
+                    ? index.takeExpired(retentionPolicy, backupTime)
+                    : index.takeExpired((size_t)std::max(maxBackupCount, 1));
+                for (const auto& old : expired) {
+                    pruner->enqueue((backupFolder / old.name).wstring());
+                }
+
+                if (!index.save()) {
+                    log(L"[警告] 保存版本索引失败: " + backupFolder.wstring(), LogLevel::Warning);
+                }
             }
+
+            runSpan.setArg(stats.bytes);
+            double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - runStart).count();
+            logRunSummary(targetDir, stats, elapsedMs);
+            recordRunMetrics(targetDir, stats, elapsedMs);
+        }
+
+        if (!metricsFile.empty() && !metrics.writeFile(metricsFile)) {
+            log(L"[警告] 写入指标文件失败: " + metricsFile, LogLevel::Warning);
         }
     } catch (const std::exception& e) {
-        log(L"[错误] 备份失败: " + std::wstring_convert<std::codecvt_utf8<wchar_t>>().from_bytes(e.what()));
+        log(L"[错误] 备份失败: " + std::wstring_convert<std::codecvt_utf8<wchar_t>>().from_bytes(e.what()), LogLevel::Error);
     }
 }
 
-void BackupManager::log(const std::wstring& msg) {
-    // 打开文件（如果文件不存在，会创建；存在则追加）
-    std::wofstream logFile("backup.log", std::ios::app);
-    if (!logFile) return;
+void BackupManager::enforceQuota(RetentionIndex& index, const std::filesystem::path& backupFolder) {
+    const unsigned long long quota = (unsigned long long)quotaMB * 1024 * 1024;
 
-    // 设置输出 locale 为 UTF-8，确保中文写入正确（使用 BOM）
-    static std::locale utf8_locale(std::locale(), new std::codecvt_utf8<wchar_t>);
-    logFile.imbue(utf8_locale);
+    // 新版本的大小按上一个版本估计，还没有版本时才遍历一次源路径
+    const BackupVersion* newest = index.newest();
+    unsigned long long incoming = newest ? newest->bytes : MeasurePathSize(runSource);
 
-    std::time_t t = std::time(nullptr);
-    std::tm local{};
-    localtime_s(&local, &t);
-    wchar_t timebuf[64];
-    wcsftime(timebuf, 64, L"[%Y-%m-%d %H:%M:%S] ", &local);
-    std::wstring fullMsg = timebuf + msg + L"\r\n";
+    auto evicted = index.takeForQuota(quota, incoming);
+    for (const auto& old : evicted) {
+        pruner->enqueue((backupFolder / old.name).wstring());
+    }
+    if (!evicted.empty()) {
+        log(L"[配额] 预计本次备份 " + std::to_wstring(incoming / (1024 * 1024)) + L" MB，淘汰 " +
+            std::to_wstring(evicted.size()) + L" 个最旧的备份，已用 " +
+            std::to_wstring(index.totalBytes() / (1024 * 1024)) + L"/" + std::to_wstring(quotaMB) + L" MB");
+    }
 
-    logFile << fullMsg;
+    // 删除通常在后台与拷贝并行；只有目标盘剩余空间放不下新版本时才等待删除完成
+    ULARGE_INTEGER freeBytes;
+    if (!evicted.empty() && GetDiskFreeSpaceExW(backupFolder.wstring().c_str(), &freeBytes, NULL, NULL) &&
+        freeBytes.QuadPart < incoming) {
+        log(L"[配额] 目标盘剩余空间不足，等待旧备份删除完成");
+        pruner->waitIdle();
+    }
+}
+
+void BackupManager::incrementalCopy(const std::filesystem::directory_entry& src, const std::wstring& relPath,
+                                    const std::wstring& destFile, BackupManifest& manifest,
+                                    bool haveManifest, const std::wstring& stagingDir, DurabilityBatch& batch,
+                                    PathInterner& createdDirs, RunStats& stats) {
+    std::error_code ec;
+    ManifestEntry current;
+    {
+        TraceSpan span(TraceEvent::Stat, TraceEnabled() ? TraceName(src.path().native()) : 0);
+        current.size = src.file_size(ec);
+        if (!ec) current.srcWriteTime = src.last_write_time(ec).time_since_epoch().count();
+    }
+    ++stats.scanned;
+    ++runProgress.filesDone;
+    if (ec) {
+        ++stats.failed;
+        log(L"[增量备份] 无法读取源文件信息: " + src.path().wstring(), LogLevel::Warning);
+        return;
+    }
+
+    bool needCopy = true;
+    if (haveManifest) {
+        const ManifestEntry* last = manifest.find(relPath);
+        needCopy = !last || last->size != current.size || last->srcWriteTime != current.srcWriteTime;
+    } else if (std::filesystem::exists(destFile, ec)) {
+        // 没有清单时（首次使用或清单丢失）退回到比较目标文件，并把结果补进清单
+        auto dstTime = std::filesystem::last_write_time(destFile, ec);
+        auto dstSize = std::filesystem::file_size(destFile, ec);
+        if (!ec && dstTime.time_since_epoch().count() == current.srcWriteTime && dstSize == current.size) {
+            needCopy = false;
+            manifest.update(relPath, current);
+        }
+    }
+
+    if (!needCopy) {
+        ++stats.skipped;
+        runProgress.bytesDone += current.size;
+        if (logger->enabled(LogLevel::Debug)) {
+            log(L"[增量备份] 跳过未修改文件: " + destFile, LogLevel::Debug);
+        }
+        return;
+    }
+
+    // 同一目录下的文件只在第一次时检查、创建上级目录
+    std::wstring_view destDir(destFile);
+    destDir = destDir.substr(0, destDir.find_last_of(L"\\/"));
+    if (!createdDirs.contains(destDir)) {
+        std::filesystem::create_directories(std::filesystem::path(destDir), ec);
+        if (!ec) createdDirs.intern(destDir);
+    }
+
+    CopyResult result;
+    result.hashContent = true;
+    result.cancel = &runCancel;
+    result.progressBytes = &runProgress.bytesDone;
+    if (BackupCopyFile(src.path().native(), destFile, stagingDir, &batch, &result)) {
+        if (result.resumedFrom > 0) {
+            log(L"[续传] 从 " + std::to_wstring(result.resumedFrom) + L" 字节处继续拷贝: " + destFile);
+            ++stats.resumed;
+        }
+        current.hash = result.contentHash;
+        manifest.update(relPath, current);
+        ++stats.copied;
+        stats.bytes += result.bytes;
+        if (logger->enabled(LogLevel::Debug)) {
+            log(L"[增量备份] 更新文件: " + destFile, LogLevel::Debug);
+        }
+    } else if (!cancelled()) {
+        ++stats.failed;
+        log(L"[增量备份] 拷贝失败: " + destFile, LogLevel::Warning);
+    }
+}
+
+bool BackupManager::startBackupAsync() {
+    if (backupRunning.exchange(true)) return false;
+    if (backupThread.joinable()) backupThread.join();
+
+    cancelRequested = false;
+    backupCancelled = false;
+    runProgress.reset();
+    backupThread = std::thread([this]() {
+        backupCancelled = requestRun(0, true);
+        cancelRequested = false;
+        backupRunning = false;
+    });
+    return true;
+}
+
+void BackupManager::cancelBackup() {
+    if (!backupRunning.load()) return;
+    std::lock_guard<std::mutex> lk(cancelMtx);
+    cancelRequested = true;
+    // 手动请求可能合并在监听线程执行的那次里，正在进行的备份不论归谁都取消
+    if (runOwner != RunOwner::None) runCancel = true;
+}
+
+void BackupManager::abortRuns() {
+    {
+        std::lock_guard<std::mutex> lk(cancelMtx);
+        aborted = true;
+        if (runOwner != RunOwner::None) runCancel = true;
+    }
+    // 因负载推迟、还在等待的备份也不再等
+    std::lock_guard<std::mutex> lk(queueMtx);
+    queueCv.notify_all();
+}
+
+void BackupManager::resumeRuns() {
+    aborted = false;
+}
+
+static std::wstring FormatBytes(unsigned long long bytes) {
+    const wchar_t* units[] = { L"B", L"KB", L"MB", L"GB", L"TB" };
+    double value = (double)bytes;
+    int unit = 0;
+    while (value >= 1024 && unit < 4) {
+        value /= 1024;
+        ++unit;
+    }
+    wchar_t buf[32];
+    swprintf(buf, 32, unit == 0 ? L"%.0f %ls" : L"%.1f %ls", value, units[unit]);
+    return buf;
+}
+
+void BackupManager::logRunSummary(const std::wstring& targetDir, const RunStats& stats, double elapsedMs) {
+    std::wstring msg = L"[统计] " + targetDir + L": 检查 " + std::to_wstring(stats.scanned) +
+                       L" 个文件，拷贝 " + std::to_wstring(stats.copied) + L" 个（" + FormatBytes(stats.bytes) +
+                       L"），跳过 " + std::to_wstring(stats.skipped) + L" 个，失败 " + std::to_wstring(stats.failed) + L" 个";
+    if (stats.resumed > 0) {
+        msg += L"，续传 " + std::to_wstring(stats.resumed) + L" 个";
+    }
+    msg += L"，耗时 " + std::to_wstring((long long)elapsedMs) + L" ms";
+    log(msg, stats.failed > 0 ? LogLevel::Warning : LogLevel::Info);
+}
+
+void BackupManager::recordRunMetrics(const std::wstring& targetDir, const RunStats& stats, double elapsedMs) {
+    uint64_t micros = (uint64_t)(elapsedMs * 1000.0);
+    metrics.filesScanned.add(stats.scanned);
+    metrics.filesCopied.add(stats.copied);
+    metrics.filesSkipped.add(stats.skipped);
+    metrics.filesFailed.add(stats.failed);
+    metrics.bytesCopied.add(stats.bytes);
+    metrics.runDuration.record(micros);
+
+    TargetMetrics& target = metrics.target(targetDir);
+    target.runs.add();
+    if (stats.failed > 0) target.failedRuns.add();
+    target.files.add(stats.copied);
+    target.bytes.add(stats.bytes);
+    target.busyMicros.add(micros);
+    // 没有写入数据的增量备份不计入速度分布，否则会被大量 0 拉低
+    if (stats.bytes > 0 && micros > 0) {
+        target.throughput.record(stats.bytes * 1000000ULL / micros);
+    }
+}
+
+void BackupManager::log(const std::wstring& msg, LogLevel level) {
+    // 只入队，时间戳和写文件由日志线程成批完成
+    logger->write(logTag.empty() ? msg : logTag + msg, level);
 }
 
 std::wstring BackupManager::getTimestamp() {
@@ -300,10 +880,50 @@ std::wstring toLower(const std::wstring& s) {
     return ret;
 }
 
+bool BackupManager::scanForChanges() {
+    if (!std::filesystem::is_directory(watchFilePath)) {
+        auto currentWrite = std::filesystem::last_write_time(watchFilePath);
+        if (currentWrite == lastFileWrite) return false;
+        lastFileWrite = currentWrite;
+        return true;
+    }
+
+    bool changed = false;
+    std::map<std::wstring, std::filesystem::file_time_type> newSnapshot;
+
+    for (auto& p : std::filesystem::recursive_directory_iterator(watchFilePath)) {
+        if (std::filesystem::is_regular_file(p)) {
+            auto path = p.path().wstring();
+            auto ftime = std::filesystem::last_write_time(p);
+            newSnapshot[path] = ftime;
+
+            auto it = lastFolderSnapshot.find(path);
+            if (it == lastFolderSnapshot.end() || it->second != ftime) {
+                changed = true;
+            }
+        }
+    }
+
+    lastFolderSnapshot = std::move(newSnapshot);
+    return changed;
+}
+
+void BackupManager::recordCommit(const std::wstring& targetDir, uint64_t detectedAt) {
+    uint64_t committedAt = MetricsNowMicros();
+    if (detectedAt != 0) {
+        metrics.changeToCommit.record(committedAt - detectedAt);
+        metrics.target(targetDir).changeToCommit.record(committedAt - detectedAt);
+    }
+    if (onCommit) onCommit(targetDir, detectedAt, committedAt);
+}
+
+void BackupManager::backupAfterChange(uint64_t detectedAt) {
+    metrics.changesDetected.add();
+    requestRun(detectedAt, false);
+}
+
 void BackupManager::watchLoop() {
     if (pollingMode) {
-        std::filesystem::file_time_type lastWrite = {};
-
         while (watching) {
             try {
                 DWORD attr = GetFileAttributesW(watchFilePath.c_str());
@@ -312,36 +932,13 @@ void BackupManager::watchLoop() {
                     break;
                 }
 
-                if (attr & FILE_ATTRIBUTE_DIRECTORY) {
-                    bool changed = false;
-                    std::map<std::wstring, std::filesystem::file_time_type> newSnapshot;
-
-                    for (auto& p : std::filesystem::recursive_directory_iterator(watchFilePath)) {
-                        if (std::filesystem::is_regular_file(p)) {
-                            auto path = p.path().wstring();
-                            auto ftime = std::filesystem::last_write_time(p);
-                            newSnapshot[path] = ftime;
-
-                            auto it = lastFolderSnapshot.find(path);
-                            if (it == lastFolderSnapshot.end() || it->second != ftime) {
-                                changed = true;
-                            }
-                        }
-                    }
-
-                    if (changed) {
-                        log(L"[轮询] 检测到文件夹中文件变更，开始备份");
-                        backupFile();
-                    }
-
-                    lastFolderSnapshot = std::move(newSnapshot);
-                } else {
-                    auto currentWrite = std::filesystem::last_write_time(watchFilePath);
-                    if (currentWrite != lastWrite) {
-                        lastWrite = currentWrite;
-                        log(L"[轮询] 检测到文件变化，开始备份");
-                        backupFile();
-                    }
+                // 变化在本次扫描开始前就已发生，以扫描开始的时间作为发现时间
+                uint64_t scanStart = MetricsNowMicros();
+                metrics.pollScans.add();
+                if (scanForChanges()) {
+                    log((attr & FILE_ATTRIBUTE_DIRECTORY) ? L"[轮询] 检测到文件夹中文件变更，开始备份"
+                                                          : L"[轮询] 检测到文件变化，开始备份");
+                    backupAfterChange(scanStart);
                 }
             } catch (...) {
                 log(L"[轮询] 检查文件状态时出错");
@@ -367,7 +964,7 @@ void BackupManager::watchLoop() {
         NULL);
 
     if (hDir == INVALID_HANDLE_VALUE) {
-        log(L"[错误] 无法打开目录句柄: " + watchDir);
+        log(L"[错误] 无法打开目录句柄: " + watchDir, LogLevel::Error);
         watching = false;
         return;
     }
@@ -386,6 +983,10 @@ void BackupManager::watchLoop() {
     HANDLE hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
     overlapped.hEvent = hEvent;
 
+    // 没有改动时一直睡到有通知或 stopWatching 置位 stopEvent，空闲时不会被唤醒
+    HANDLE waits[2] = { hEvent, stopEvent };
+    bool ioPending = false;
+
     while (watching) {
         ResetEvent(hEvent);
 
@@ -400,18 +1001,21 @@ void BackupManager::watchLoop() {
             NULL);
 
         if (!success) {
-            log(L"[错误] 启动 ReadDirectoryChangesW 异步监听失败");
+            log(L"[错误] 启动 ReadDirectoryChangesW 异步监听失败", LogLevel::Error);
             break;
         }
+        ioPending = true;
 
-        DWORD waitResult = WaitForSingleObject(hEvent, 500);  // 最多等待500ms
+        DWORD waitResult = WaitForMultipleObjects(2, waits, FALSE, INFINITE);
 
-        if (!watching) break;
+        if (waitResult == WAIT_OBJECT_0 + 1 || !watching) break;
 
         if (waitResult == WAIT_OBJECT_0) {
+            const uint64_t arrivedAt = MetricsNowMicros();  // 通知到达的时间，同一批里的改动都按它计算延迟
             DWORD bytesReturned = 0;
+            ioPending = false;
             if (!GetOverlappedResult(hDir, &overlapped, &bytesReturned, FALSE)) {
-                log(L"[错误] GetOverlappedResult 失败");
+                log(L"[错误] GetOverlappedResult 失败", LogLevel::Error);
                 break;
             }
 
@@ -422,30 +1026,37 @@ void BackupManager::watchLoop() {
                 FILE_NOTIFY_INFORMATION* fni = (FILE_NOTIFY_INFORMATION*)(buffer + offset);
                 std::wstring changedName(fni->FileName, fni->FileNameLength / sizeof(WCHAR));
                 std::wstring changedNameLower = toLower(changedName);
+                metrics.eventsReceived.add();
 
-                log(L"[事件] 文件: " + changedName + L", 动作: " + std::to_wstring(fni->Action));
+                if (logger->enabled(LogLevel::Debug)) {
+                    log(L"[事件] 文件: " + changedName + L", 动作: " + std::to_wstring(fni->Action), LogLevel::Debug);
+                }
 
                 if ((fni->Action == FILE_ACTION_MODIFIED ||
                      fni->Action == FILE_ACTION_ADDED ||
                      fni->Action == FILE_ACTION_RENAMED_NEW_NAME) &&
                     changedNameLower == watchFileNameLower) {
                     log(L"[事件] 匹配到目标文件改动，开始备份: " + changedName);
-                    backupFile();
+                    backupAfterChange(arrivedAt);
                 }
 
                 if (fni->NextEntryOffset == 0) break;
                 offset += fni->NextEntryOffset;
             }
-        } else if (waitResult == WAIT_TIMEOUT) {
-            continue;  // 继续下一轮监听
         } else {
-            log(L"[错误] WaitForSingleObject 异常");
+            log(L"[错误] WaitForMultipleObjects 异常", LogLevel::Error);
             break;
         }
     }
 
+    // buffer 在栈上，必须等取消的请求真正结束后才能离开
+    if (ioPending) {
+        DWORD ignored = 0;
+        CancelIoEx(hDir, &overlapped);
+        GetOverlappedResult(hDir, &overlapped, &ignored, TRUE);
+    }
     CloseHandle(hEvent);
     CloseHandle(hDir);
     hDir = INVALID_HANDLE_VALUE;
     watching = false;
-}
\ No newline at end of file
+}
\ No newline at end of file
@@ -10,10 +10,49 @@
 #include <memory>
 #include <condition_variable>
 #include <mutex>
+#include <functional>
+#include "retention.h"
+#include "logger.h"
+#include "metrics.h"
+#include "loadgate.h"
+
+class BackupManifest;
+class DurabilityBatch;
+class PathInterner;
+
+// 单个目标一次备份的统计，备份结束时汇总成一行日志
+struct RunStats {
+    unsigned long long scanned = 0;   // 检查过的源文件
+    unsigned long long copied = 0;
+    unsigned long long skipped = 0;   // 未修改而跳过
+    unsigned long long failed = 0;
+    unsigned long long resumed = 0;   // 从检查点续传的大文件
+    unsigned long long bytes = 0;     // 实际写入的字节数
+};
+
+// 一次备份的进度：备份线程更新，界面等任意线程随时读取
+struct BackupProgress {
+    std::atomic<unsigned long long> filesDone{ 0 };
+    std::atomic<unsigned long long> filesTotal{ 0 };  // 开始前遍历源路径得到的估计值（每个目标各算一遍）
+    std::atomic<unsigned long long> bytesDone{ 0 };   // 已拷贝和增量模式下跳过的字节数
+    std::atomic<unsigned long long> bytesTotal{ 0 };
+    std::atomic<uint64_t> startedAt{ 0 };             // MetricsNowMicros
+
+    void reset();
+    double fraction() const;    // 0 ~ 1，按字节计算，源路径全是空文件时按文件数
+    double etaSeconds() const;  // 按目前的平均速度估计剩余秒数，还无法估计时返回 -1
+};
 
 class BackupManager {
 public:
+    // 某个目标的数据落盘后回调：detectedAt 为发现变化的时间（MetricsNowMicros），手动备份时为 0
+    using CommitCallback = std::function<void(const std::wstring& targetDir, uint64_t detectedAt, uint64_t committedAt)>;
+
     BackupManager();
+    // 多作业引擎中使用：日志和清理线程由所有作业共用，tag 加在本作业每条日志的前面；
+    // 负载推迟由引擎在排队时处理，这里默认不启用
+    BackupManager(std::shared_ptr<AsyncLogger> sharedLogger, std::shared_ptr<PruneWorker> sharedPruner,
+                  const std::wstring& tag);
     ~BackupManager();
 
     std::unique_ptr<std::thread> watchThread;
@@ -25,36 +64,150 @@ public:
     bool pollingMode = false;       // 是否启用轮询模式（U盘监听）
     bool incrementalMode = false;   // 是否启用增量备份模式
     int pollingInterval = 3000;
+    RetentionPolicy retentionPolicy;  // 分级保留策略，启用后代替 maxBackupCount
+    int quotaMB = 0;                  // 每个目标的备份占用上限（MB），0 表示不限制
+    LogLevel logLevel = LogLevel::Info;
+    LogRotation logRotation;
+    bool traceEnabled = false;        // 是否记录二进制耗时跟踪，停止监听时或 dumpTrace() 写出到 backup.trace
+    std::wstring metricsFile;         // 每次备份后写入 Prometheus 格式的指标，为空时不写
+    bool lowPriority = true;          // 备份期间执行线程进入后台模式（低 CPU 与磁盘 I/O 优先级）
+    LoadLimits loadLimits;            // 系统负载高时推迟监听发起的备份，手动备份不推迟
+
+    BackupMetrics metrics;  // 运行指标，任意线程可读
 
     void setMaxBackupCount(int count);
+    void setRetentionPolicy(const RetentionPolicy& policy);
+    void setQuotaMB(int megabytes);
+    void setLogLevel(LogLevel level);
+    void setLogRotation(const LogRotation& rotation);
+    void setTraceEnabled(bool enabled);
+    bool dumpTrace();  // 跟踪已启用时把当前的记录写到 backup.trace，未启用或写入失败返回 false
+    void setMetricsFile(const std::wstring& path);
+    void setLowPriority(bool enabled);
+    void setLoadLimits(const LoadLimits& limits);
+    void setCommitCallback(CommitCallback callback);  // 须在 startWatching() 之前设置
+    // 源路径、目标和备份模式可以随时修改，正在进行的备份不受影响，从下一次开始生效；
+    // 源路径和轮询模式在监听期间不能修改（调用被忽略）
     void setWatchFile(const std::wstring& fullPath);
     void addBackupTarget(const std::wstring& targetDir);
     void clearBackupTargets();
+    void setBackupTargets(const std::vector<std::wstring>& targets);  // 一次替换全部目标
 
     bool startWatching();
     void stopWatching();
     bool isWatching() const;
 
-    void backupFile(); // 立即执行一次备份
+    void backupFile(); // 立即执行一次备份；已有备份在进行时合并到它结束后的下一次，并等那次完成
+
+    // 在后台线程执行一次备份并立即返回，进度见 progress()；已有后台备份在运行时返回 false
+    bool startBackupAsync();
+    // 请求取消正在进行的手动备份：当前文件（大文件为当前数据块）结束后停止。
+    // 取消或停止监听时，已完成的文件照常落盘；完整备份中未完成的版本文件夹交给清理线程删除
+    void cancelBackup();
+    // 取消正在进行的备份（不论由谁发起、在哪个线程上执行），之后的请求也立即按取消结束，
+    // 直到 resumeRuns()；多作业引擎停止时在等待工作线程之前调用
+    void abortRuns();
+    void resumeRuns();
+    bool isBackupRunning() const { return backupRunning.load(); }
+    // 上一次后台备份是否被取消（包括因停止监听而中止的）
+    bool lastBackupCancelled() const { return backupCancelled.load(); }
+    const BackupProgress& progress() const { return runProgress; }
+
+    // 轮询一次源路径并与上次的快照比较，返回是否有文件新增或修改（第一次调用总是返回 true）
+    bool scanForChanges();
 
     void setPollingMode(bool enabled);       // 启用或禁用轮询模式（用于U盘）
     void setIncrementalMode(bool enabled);   // 启用或禁用增量备份模式
     void setPollingInterval(int milliseconds); // 设置轮询时间间隔
 
+    // 监听到变化后请求备份，并记录从发现变化（detectedAt，MetricsNowMicros）到备份完成的延迟；
+    // 已有备份在进行时只登记，不等待
+    void backupAfterChange(uint64_t detectedAt);
+
 private:
+    enum class RunOwner { None, Watcher, Other };
+
     void watchLoop();       // 标准的目录事件监听线程
 
-    void log(const std::wstring& msg);
+    // 所有备份（监听、手动、守护进程、多作业引擎）都经过这个队列，同一时刻只有一次备份：
+    // 空闲时由调用线程立即执行；已有备份在进行时只登记为待办，进行中的那次结束后由执行它的线程
+    // 把期间所有请求合并为一次再执行。wait 为 true 时等到包含本请求的那次备份结束。
+    // 返回包含本请求的那次备份是否被取消（不等待且已合并时返回 false）
+    bool requestRun(uint64_t detectedAt, bool wait);
+
+    // 执行一次备份，返回是否被取消；在监听线程上执行时由 stopWatching 取消，否则由 cancelBackup 取消
+    bool runBackup();
+    bool onWatchThread();
+    // 待办请求都不紧急（全部由发现变化发起）时，系统繁忙就等到负载下降、有手动请求、停止监听
+    // 或达到最长推迟时间为止；调用时持有 queueMtx，等待期间释放
+    void deferWhileBusy(std::unique_lock<std::mutex>& lk);
+    void copyToTargets();
+
+    // 目标数据落盘后记录变化到落盘的延迟并通知回调
+    void recordCommit(const std::wstring& targetDir, uint64_t detectedAt);
+
+    // 增量模式下按清单判断单个文件是否需要拷贝，需要时拷贝并更新清单；
+    // createdDirs 记录本次已经建好的目标目录
+    void incrementalCopy(const std::filesystem::directory_entry& src, const std::wstring& relPath,
+                         const std::wstring& destFile, BackupManifest& manifest,
+                         bool haveManifest, const std::wstring& stagingDir, DurabilityBatch& batch,
+                         PathInterner& createdDirs, RunStats& stats);
+
+    // 完整备份前按配额预先淘汰旧版本，保证新版本写入后不超过上限
+    void enforceQuota(RetentionIndex& index, const std::filesystem::path& backupFolder);
+
+    void logRunSummary(const std::wstring& targetDir, const RunStats& stats, double elapsedMs);
+    void recordRunMetrics(const std::wstring& targetDir, const RunStats& stats, double elapsedMs);
+
+    void log(const std::wstring& msg, LogLevel level = LogLevel::Info);
     std::wstring getTimestamp();
 
+    bool cancelled() const { return runCancel.load(std::memory_order_relaxed); }
+
+    std::filesystem::file_time_type lastFileWrite{};  // 单文件轮询时上次看到的修改时间
+    std::atomic<uint64_t> changeDetectedAt{ 0 };      // 正在为哪次变化备份，0 表示手动备份
+    CommitCallback onCommit;
+
     std::wstring watchFilePath;
     std::wstring watchDir;
     std::wstring watchFileName;
 
     std::vector<std::wstring> backupTargets;
 
+    // 正在执行的这次备份的源路径、目标和模式，requestRun 在持有 queueMtx 时从上面的设置复制，只由执行线程读取
+    std::wstring runSource;
+    std::vector<std::wstring> runTargets;
+    bool runIncremental = false;
+
     HANDLE hDir = INVALID_HANDLE_VALUE;
+    HANDLE stopEvent = NULL;  // 手动重置，stopWatching 时置位；事件模式下与目录通知一起等待
 
     std::condition_variable cv;
     std::mutex cv_mtx;
+
+    // 备份请求队列，见 requestRun()
+    std::mutex queueMtx;
+    std::condition_variable queueCv;
+    bool runnerActive = false;
+    uint64_t requestSeq = 0;          // 已登记的请求序号
+    uint64_t completedSeq = 0;        // 已完成的备份覆盖到的请求序号
+    uint64_t pendingDetectedAt = 0;   // 待办请求里最早一次变化的时间，0 表示只有手动请求
+    bool pendingUrgent = false;       // 待办请求里有手动请求（不因负载推迟）
+    bool lastRunCancelled = false;
+    std::thread backupThread;
+    std::atomic<bool> backupRunning{ false };
+    std::atomic<bool> backupCancelled{ false };
+    std::atomic<bool> aborted{ false };          // abortRuns() 之后、resumeRuns() 之前
+    std::atomic<bool> cancelRequested{ false };  // cancelBackup() 请求取消手动备份，后台备份结束时清除
+    std::mutex cancelMtx;                        // 保护 runOwner，以及 runCancel 的置位与 watching 的修改
+    RunOwner runOwner = RunOwner::None;
+    std::thread::id watchThreadId;               // 正在运行的监听线程，没有时为空
+    std::atomic<bool> runCancel{ false };        // 当前这次备份的取消标志，拷贝循环检查它
+    BackupProgress runProgress;
+    LoadGate loadGate;
+
+    std::map<std::wstring, RetentionIndex> retentionIndex;  // 备份文件夹 -> 版本索引
+    std::wstring logTag;
+    std::shared_ptr<AsyncLogger> logger;  // 须在 pruner 之前声明，清理线程结束前仍会写日志
+    std::shared_ptr<PruneWorker> pruner;  // 放在最后，析构时最先结束清理线程
 };
@@ -0,0 +1,769 @@
+// DAB 性能基准（控制台程序），每项结果输出一行 JSON，便于跨版本对比。
+// 用法: bench.exe [--files N] [--size 平均字节数] [--depth 目录层数] [--fanout 每层子目录数]
+//                 [--mutate 修改百分比] [--seed 随机种子] [--versions 清理测试的版本数] [--dir 临时目录]
+//                 [--changes 延迟测试的修改次数] [--change-interval 两次修改的间隔毫秒] [--poll-ms 轮询间隔毫秒]
+//                 [--stop-mb 停止测试的大文件 MB]
+// 开头的 check 几项（时间轮、分级保留、直方图）和分配次数带有断言，任一项不满足时输出 FAIL 并返回 1。
+#include "backup.h"
+#include "copyengine.h"
+#include "patharena.h"
+#include "logview.h"
+#include "manifest.h"
+#include "retention.h"
+#include "timerwheel.h"
+#include "metrics.h"
+#include <windows.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cwchar>
+#include <filesystem>
+#include <cmath>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdlib>
+#include <ctime>
+#include <new>
+
+// 替换全局 operator new，统计本程序所有线程的堆分配次数（见 BenchAllocations）
+static std::atomic<unsigned long long> g_allocations{ 0 };
+
+void* operator new(std::size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+struct BenchOptions {
+    int files = 500;
+    unsigned long long fileSize = 64 * 1024;
+    int depth = 3;
+    int fanout = 4;
+    double mutatePercent = 1.0;
+    unsigned seed = 1;
+    int versions = 20;
+    int changes = 20;
+    int changeIntervalMs = 1000;
+    int pollMs = 500;
+    int stopFileMB = 256;
+    std::wstring dir;
+};
+
+// 可重复的伪随机数（xorshift32），同样的种子生成同样的目录树
+struct Rng {
+    unsigned state;
+    explicit Rng(unsigned seed) : state(seed ? seed : 0x9E3779B9u) {}
+    unsigned next() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+    double uniform() { return (next() & 0xFFFFFF) / double(0x1000000); }
+};
+
+struct SyntheticTree {
+    std::vector<std::wstring> files;
+    unsigned long long bytes = 0;
+};
+
+double ElapsedMs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// 不满足的检查项数；有失败时 bench.exe 返回 1，可以直接当作回归检查运行
+int g_failures = 0;
+
+void Expect(bool ok, const char* what) {
+    if (ok) return;
+    ++g_failures;
+    std::fprintf(stderr, "FAIL: %s\n", what);
+}
+
+bool WriteTestFile(const std::wstring& path, unsigned long long size, unsigned seed) {
+    HANDLE h = CreateFileW(path.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (h == INVALID_HANDLE_VALUE) return false;
+
+    std::vector<unsigned char> buf(64 * 1024);
+    unsigned x = seed * 2654435761u + 1;
+    for (auto& b : buf) {
+        x = x * 1103515245u + 12345u;
+        b = (unsigned char)(x >> 16);
+    }
+
+    bool ok = true;
+    unsigned long long remaining = size;
+    while (ok && remaining > 0) {
+        DWORD chunk = (DWORD)std::min<unsigned long long>(remaining, buf.size());
+        DWORD written = 0;
+        ok = WriteFile(h, buf.data(), chunk, &written, NULL) && written == chunk;
+        remaining -= chunk;
+    }
+    CloseHandle(h);
+    return ok;
+}
+
+// 生成 depth 层、每层 fanout 个子目录的目录树，文件轮流放进各个目录。
+// 文件大小按指数分布（大多数是小文件，少数较大），均值为 fileSize。
+SyntheticTree GenerateTree(const std::filesystem::path& root, const BenchOptions& opt) {
+    std::vector<std::filesystem::path> dirs = { root };
+    std::vector<std::filesystem::path> level = { root };
+    for (int d = 0; d < opt.depth; ++d) {
+        std::vector<std::filesystem::path> nextLevel;
+        for (const auto& parent : level) {
+            for (int f = 0; f < opt.fanout; ++f) {
+                nextLevel.push_back(parent / (L"d" + std::to_wstring(f)));
+            }
+        }
+        dirs.insert(dirs.end(), nextLevel.begin(), nextLevel.end());
+        level.swap(nextLevel);
+    }
+    for (const auto& d : dirs) std::filesystem::create_directories(d);
+
+    SyntheticTree tree;
+    Rng rng(opt.seed);
+    for (int i = 0; i < opt.files; ++i) {
+        double u = rng.uniform();
+        unsigned long long size = (unsigned long long)(-std::log(1.0 - u) * (double)opt.fileSize);
+        std::wstring path = (dirs[i % dirs.size()] / (L"f" + std::to_wstring(i) + L".bin")).wstring();
+        WriteTestFile(path, size, rng.next());
+        tree.files.push_back(path);
+        tree.bytes += size;
+    }
+    return tree;
+}
+
+// 改写 percent% 的文件（至少一个），返回改写的文件数
+int MutateTree(const SyntheticTree& tree, double percent, unsigned seed) {
+    int count = std::max(1, (int)(tree.files.size() * percent / 100.0));
+    Rng rng(seed);
+    for (int i = 0; i < count; ++i) {
+        const std::wstring& path = tree.files[rng.next() % tree.files.size()];
+        HANDLE h = CreateFileW(path.c_str(), GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (h == INVALID_HANDLE_VALUE) continue;
+        unsigned value = rng.next();
+        DWORD written = 0;
+        WriteFile(h, &value, sizeof(value), &written, NULL);
+
+        // 修改时间往后推一秒，FAT 等低精度文件系统上也能看出变化
+        FILETIME ft;
+        GetFileTime(h, NULL, NULL, &ft);
+        ULARGE_INTEGER t;
+        t.LowPart = ft.dwLowDateTime;
+        t.HighPart = ft.dwHighDateTime;
+        t.QuadPart += 10000000ULL * (i + 1);
+        ft.dwLowDateTime = t.LowPart;
+        ft.dwHighDateTime = t.HighPart;
+        SetFileTime(h, NULL, NULL, &ft);
+        CloseHandle(h);
+    }
+    return count;
+}
+
+void PrintTreeResult(const char* name, const BenchOptions& opt, const SyntheticTree& tree, double ms,
+                     int changed = 0) {
+    std::printf("{\"bench\":\"tree\",\"case\":\"%s\",\"files\":%d,\"bytes\":%llu,\"depth\":%d,"
+                "\"fanout\":%d,\"changed\":%d,\"ms\":%.3f,\"files_per_s\":%.1f}\n",
+                name, opt.files, tree.bytes, opt.depth, opt.fanout, changed, ms,
+                ms > 0 ? opt.files * 1000.0 / ms : 0.0);
+}
+
+// 用 BackupManager 跑完整备份、增量备份（无变化 / 部分变化）、轮询扫描和旧版本清理
+void BenchTree(const BenchOptions& opt) {
+    std::filesystem::path root = std::filesystem::path(opt.dir) / L"tree";
+    std::filesystem::path src = root / L"src";
+    std::filesystem::remove_all(root);
+
+    SyntheticTree tree = GenerateTree(src, opt);
+
+    BackupManager mgr;
+    mgr.setLogLevel(LogLevel::Error);
+    mgr.setWatchFile(src.wstring());
+
+    // 完整备份（CopyDirectoryRecursive）
+    {
+        std::filesystem::path dst = root / L"full";
+        std::filesystem::create_directories(dst);
+        mgr.clearBackupTargets();
+        mgr.addBackupTarget(dst.wstring());
+        mgr.setIncrementalMode(false);
+        mgr.setMaxBackupCount(1000);
+
+        auto start = std::chrono::steady_clock::now();
+        mgr.backupFile();
+        PrintTreeResult("full_backup", opt, tree, ElapsedMs(start));
+    }
+
+    // 增量备份：首次（全部拷贝并建立清单）、无变化、修改 mutatePercent% 之后
+    {
+        std::filesystem::path dst = root / L"incremental";
+        std::filesystem::create_directories(dst);
+        mgr.clearBackupTargets();
+        mgr.addBackupTarget(dst.wstring());
+        mgr.setIncrementalMode(true);
+
+        auto start = std::chrono::steady_clock::now();
+        mgr.backupFile();
+        PrintTreeResult("incremental_initial", opt, tree, ElapsedMs(start));
+
+        start = std::chrono::steady_clock::now();
+        mgr.backupFile();
+        PrintTreeResult("incremental_noop", opt, tree, ElapsedMs(start));
+
+        int changed = MutateTree(tree, opt.mutatePercent, opt.seed + 1);
+        start = std::chrono::steady_clock::now();
+        mgr.backupFile();
+        PrintTreeResult("incremental_changed", opt, tree, ElapsedMs(start), changed);
+    }
+
+    // 轮询扫描：第一次建立快照，之后无变化时的稳态开销取几次的平均
+    {
+        auto start = std::chrono::steady_clock::now();
+        mgr.scanForChanges();
+        PrintTreeResult("poll_scan_initial", opt, tree, ElapsedMs(start));
+
+        const int rounds = 5;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < rounds; ++i) mgr.scanForChanges();
+        PrintTreeResult("poll_scan_steady", opt, tree, ElapsedMs(start) / rounds);
+
+        int changed = MutateTree(tree, opt.mutatePercent, opt.seed + 2);
+        start = std::chrono::steady_clock::now();
+        bool detected = mgr.scanForChanges();
+        PrintTreeResult(detected ? "poll_scan_changed" : "poll_scan_changed_missed", opt, tree, ElapsedMs(start), changed);
+    }
+
+    // 清理：复制出 versions 个版本，计时版本索引的加载和后台删除全部完成
+    {
+        std::filesystem::path folder = root / L"prune";
+        std::filesystem::create_directories(folder);
+        for (int v = 0; v < opt.versions; ++v) {
+            wchar_t name[64];
+            swprintf(name, 64, L"src_20250101_%06d", v);
+            std::filesystem::copy(src, folder / name, std::filesystem::copy_options::recursive);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        RetentionIndex index;
+        index.load(folder.wstring());
+        double loadMs = ElapsedMs(start);
+
+        PruneWorker pruner([](const std::wstring&) {});
+        start = std::chrono::steady_clock::now();
+        for (const auto& old : index.takeExpired((size_t)1)) {
+            pruner.enqueue((folder / old.name).wstring());
+        }
+        pruner.waitIdle();
+        double pruneMs = ElapsedMs(start);
+
+        std::printf("{\"bench\":\"tree\",\"case\":\"prune\",\"files\":%d,\"versions\":%d,"
+                    "\"index_load_ms\":%.3f,\"ms\":%.3f,\"versions_per_s\":%.1f}\n",
+                    opt.files, opt.versions, loadMs, pruneMs,
+                    pruneMs > 0 ? (opt.versions - 1) * 1000.0 / pruneMs : 0.0);
+    }
+
+    std::error_code ec;
+    std::filesystem::remove_all(root, ec);
+}
+
+// 变化到落盘的端到端延迟：按固定间隔改写被监听的文件，从改写开始计时，
+// 到提交回调报告该次变化已在目标上落盘为止。分别测事件模式和轮询模式。
+void BenchLatency(const BenchOptions& opt, bool polling) {
+    std::filesystem::path root = std::filesystem::path(opt.dir) / L"latency";
+    std::filesystem::path dst = root / L"dst";
+    std::filesystem::remove_all(root);
+    std::filesystem::create_directories(root / L"src");
+    std::filesystem::create_directories(dst);
+    std::wstring doc = (root / L"src" / L"document.bin").wstring();
+    WriteTestFile(doc, opt.fileSize, opt.seed);
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    uint64_t lastDetected = 0;
+    uint64_t lastCommitted = 0;
+
+    BackupManager mgr;
+    mgr.setLogLevel(LogLevel::Error);
+    LoadLimits noDefer;
+    noDefer.enabled = false;
+    mgr.setLoadLimits(noDefer);  // 基准本身就占满 CPU 和磁盘，不能让备份因负载推迟
+    mgr.setWatchFile(doc);
+    mgr.addBackupTarget(dst.wstring());
+    mgr.setMaxBackupCount(3);
+    mgr.setPollingMode(polling);
+    mgr.setPollingInterval(opt.pollMs);
+    mgr.setCommitCallback([&](const std::wstring&, uint64_t detectedAt, uint64_t committedAt) {
+        std::lock_guard<std::mutex> lk(mtx);
+        lastDetected = detectedAt;
+        lastCommitted = committedAt;
+        cv.notify_all();
+    });
+    if (!mgr.startWatching()) return;
+    std::this_thread::sleep_for(std::chrono::milliseconds(polling ? opt.pollMs * 2 : 200));  // 等首次轮询或监听就绪
+
+    std::vector<double> latencies;
+    int missed = 0;
+    for (int i = 0; i < opt.changes; ++i) {
+        auto slot = std::chrono::steady_clock::now() + std::chrono::milliseconds(opt.changeIntervalMs);
+        uint64_t changedAt = MetricsNowMicros();
+        WriteTestFile(doc, opt.fileSize, opt.seed + i + 1);
+
+        // 只认发现时间不早于本次改写的提交，前一次改写的重复事件不算
+        std::unique_lock<std::mutex> lk(mtx);
+        bool done = cv.wait_for(lk, std::chrono::seconds(10), [&]() { return lastDetected >= changedAt; });
+        if (done) latencies.push_back((lastCommitted - changedAt) / 1000.0);
+        else ++missed;
+        lk.unlock();
+
+        std::this_thread::sleep_until(slot);
+    }
+    mgr.stopWatching();
+
+    std::sort(latencies.begin(), latencies.end());
+    auto pick = [&](double q) {
+        if (latencies.empty()) return 0.0;
+        size_t idx = (size_t)std::ceil(q * latencies.size());
+        return latencies[idx > 0 ? idx - 1 : 0];
+    };
+    std::printf("{\"bench\":\"latency\",\"mode\":\"%s\",\"changes\":%d,\"interval_ms\":%d,\"poll_ms\":%d,"
+                "\"bytes\":%llu,\"p50_ms\":%.3f,\"p99_ms\":%.3f,\"max_ms\":%.3f,\"missed\":%d}\n",
+                polling ? "polling" : "event", opt.changes, opt.changeIntervalMs, polling ? opt.pollMs : 0,
+                opt.fileSize, pick(0.5), pick(0.99), latencies.empty() ? 0.0 : latencies.back(), missed);
+
+    std::error_code ec;
+    std::filesystem::remove_all(root, ec);
+}
+
+// 备份进行中停止监听要多久：轮询模式的第一次扫描会触发完整备份，拷贝开始后调用 stopWatching()，
+// 计时到监听线程退出。分别测目录树（文件之间取消）和单个大文件（数据块之间取消）。
+void BenchStop(const BenchOptions& opt) {
+    std::filesystem::path root = std::filesystem::path(opt.dir) / L"stop";
+    std::filesystem::remove_all(root);
+
+    for (int c = 0; c < 2; ++c) {
+        const bool largeFile = c == 1;
+        std::filesystem::path dst = root / (largeFile ? L"dst_large" : L"dst_tree");
+        std::filesystem::create_directories(dst);
+        std::wstring source;
+        if (largeFile) {
+            std::filesystem::create_directories(root / L"large");
+            source = (root / L"large" / L"big.bin").wstring();
+            WriteTestFile(source, (unsigned long long)opt.stopFileMB * 1024 * 1024, opt.seed);
+        } else {
+            GenerateTree(root / L"tree", opt);
+            source = (root / L"tree").wstring();
+        }
+
+        BackupManager mgr;
+        mgr.setLogLevel(LogLevel::Error);
+        LoadLimits noDefer;
+        noDefer.enabled = false;
+        mgr.setLoadLimits(noDefer);
+        mgr.setWatchFile(source);
+        mgr.addBackupTarget(dst.wstring());
+        mgr.setPollingMode(true);
+        mgr.setPollingInterval(opt.pollMs);
+        if (!mgr.startWatching()) continue;
+
+        // 等拷贝真正开始（已有字节写出）再停止
+        const BackupProgress& p = mgr.progress();
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+        while (p.bytesDone.load() == 0 && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+        unsigned long long filesAtStop = p.filesDone.load();
+        unsigned long long bytesAtStop = p.bytesDone.load();
+        auto start = std::chrono::steady_clock::now();
+        mgr.stopWatching();
+        double stopMs = ElapsedMs(start);
+
+        std::printf("{\"bench\":\"stop\",\"case\":\"%s\",\"files_done\":%llu,\"bytes_done\":%llu,"
+                    "\"stop_ms\":%.3f,\"cancelled\":%llu}\n",
+                    largeFile ? "large_file" : "tree", filesAtStop, bytesAtStop, stopMs,
+                    (unsigned long long)mgr.metrics.backupsCancelled.get());
+    }
+
+    std::error_code ec;
+    std::filesystem::remove_all(root, ec);
+}
+
+// 逐文件 FlushFileBuffers 与整批统一刷盘的耗时对比
+void BenchDurability(const BenchOptions& opt) {
+    std::filesystem::path root = std::filesystem::path(opt.dir) / L"durability";
+    std::filesystem::path src = root / L"src";
+    std::filesystem::remove_all(root);
+    std::filesystem::create_directories(src);
+
+    std::vector<std::wstring> names;
+    for (int i = 0; i < opt.files; ++i) {
+        std::wstring name = L"f" + std::to_wstring(i) + L".bin";
+        WriteTestFile((src / name).wstring(), opt.fileSize, (unsigned)i);
+        names.push_back(name);
+    }
+
+    const bool modes[] = { true, false };
+    for (bool perFile : modes) {
+        std::filesystem::path dst = root / (perFile ? L"dst_per_file" : L"dst_batched");
+        std::filesystem::create_directories(dst);
+        std::wstring staging = (dst / STAGING_DIR_NAME).wstring();
+
+        DurabilityBatch batch(perFile);
+        int failures = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (const auto& name : names) {
+            if (!BackupCopyFile((src / name).wstring(), (dst / name).wstring(), staging, &batch)) ++failures;
+        }
+        double copyMs = ElapsedMs(start);
+        bool synced = batch.commit();
+        double totalMs = ElapsedMs(start);
+
+        std::printf("{\"bench\":\"durability\",\"mode\":\"%s\",\"files\":%d,\"file_size\":%llu,"
+                    "\"copy_ms\":%.3f,\"total_ms\":%.3f,\"failures\":%d,\"synced\":%s}\n",
+                    perFile ? "per_file_fsync" : "batched_sync", opt.files, opt.fileSize,
+                    copyMs, totalMs, failures, synced ? "true" : "false");
+    }
+
+    std::error_code ec;
+    std::filesystem::remove_all(root, ec);
+}
+
+// 无变化的增量备份每个文件的平均分配次数，最多比"单纯遍历目录 + 读入清单"多这么多。
+// 目录迭代器每一项都要为路径分配（libstdc++ 还要拆分路径分量，次数随路径深度变化），读清单每个条目要建哈希表节点，
+// 所以以同一棵树上这两步单独的分配为基准；扫描路径上自己的逐文件分配应当为 0，留一点余量给每个目录一次的开销
+const double NOOP_EXTRA_ALLOCATIONS_PER_FILE = 0.5;
+
+// 堆分配次数：先单独比较拼路径的两种方式（每项新建字符串 / 复用缓冲），
+// 再统计完整备份和无变化增量备份每个文件平均的分配次数。
+// 计数包含标准库目录迭代器、日志线程等的分配，是整个备份路径的总量。
+// 复用缓冲拼路径、无变化增量备份比单纯遍历加读清单多出逐文件分配时记为失败。
+void BenchAllocations(const BenchOptions& opt) {
+    std::filesystem::path root = std::filesystem::path(opt.dir) / L"alloc";
+    std::filesystem::path src = root / L"src";
+    std::filesystem::remove_all(root);
+    SyntheticTree tree = GenerateTree(src, opt);
+
+    std::vector<std::pair<std::wstring, std::wstring>> split;  // (所在目录, 文件名)
+    for (const auto& f : tree.files) {
+        size_t sep = f.find_last_of(L'\\');
+        split.emplace_back(f.substr(0, sep), f.substr(sep + 1));
+    }
+    const std::wstring dstRoot = (root / L"dst").wstring();
+
+    size_t checksum = 0;
+    unsigned long long before = g_allocations.load();
+    for (const auto& item : split) {
+        std::wstring srcPath = item.first + L"\\" + item.second;
+        std::wstring dstPath = dstRoot + L"\\" + item.second;
+        checksum += srcPath.size() + dstPath.size();
+    }
+    unsigned long long concat = g_allocations.load() - before;
+
+    before = g_allocations.load();
+    PathBuffer srcBuf, dstBuf;
+    dstBuf.assign(dstRoot);
+    for (const auto& item : split) {
+        srcBuf.assign(item.first);
+        size_t dstLen = dstBuf.push(item.second);
+        srcBuf.push(item.second);
+        checksum += srcBuf.size() + dstBuf.size();
+        dstBuf.truncate(dstLen);
+    }
+    unsigned long long buffered = g_allocations.load() - before;
+
+    std::printf("{\"bench\":\"alloc\",\"case\":\"path_concat\",\"files\":%d,\"allocations\":%llu,\"per_file\":%.2f}\n",
+                opt.files, concat, opt.files > 0 ? (double)concat / opt.files : 0.0);
+    std::printf("{\"bench\":\"alloc\",\"case\":\"path_buffer\",\"files\":%d,\"allocations\":%llu,\"per_file\":%.2f,"
+                "\"checksum\":%zu}\n",
+                opt.files, buffered, opt.files > 0 ? (double)buffered / opt.files : 0.0, checksum);
+    // 两个缓冲各自预留一次，路径超过预留长度时再各扩一次，与文件数无关
+    Expect(buffered <= 4, "alloc path_buffer: reused buffers allocate per file");
+
+    // 基准：只用目录迭代器走一遍源树
+    size_t walked = 0;
+    before = g_allocations.load();
+    for (auto& entry : std::filesystem::recursive_directory_iterator(src)) {
+        if (entry.is_regular_file()) ++walked;
+    }
+    unsigned long long iterate = g_allocations.load() - before;
+    const double iteratePerFile = opt.files > 0 ? (double)iterate / opt.files : 0.0;
+    std::printf("{\"bench\":\"alloc\",\"case\":\"iterate_only\",\"files\":%zu,\"allocations\":%llu,\"per_file\":%.2f}\n",
+                walked, iterate, iteratePerFile);
+
+    BackupManager mgr;
+    mgr.setLogLevel(LogLevel::Error);
+    mgr.setWatchFile(src.wstring());
+    auto measure = [&](const char* name) {
+        unsigned long long start = g_allocations.load();
+        auto begin = std::chrono::steady_clock::now();
+        mgr.backupFile();
+        double ms = ElapsedMs(begin);
+        unsigned long long count = g_allocations.load() - start;
+        std::printf("{\"bench\":\"alloc\",\"case\":\"%s\",\"files\":%d,\"allocations\":%llu,\"per_file\":%.2f,\"ms\":%.3f}\n",
+                    name, opt.files, count, opt.files > 0 ? (double)count / opt.files : 0.0, ms);
+        return opt.files > 0 ? (double)count / opt.files : 0.0;
+    };
+
+    std::filesystem::create_directories(root / L"full");
+    mgr.addBackupTarget((root / L"full").wstring());
+    mgr.setMaxBackupCount(1000);
+    measure("full_backup");
+
+    std::filesystem::create_directories(root / L"incremental");
+    mgr.clearBackupTargets();
+    mgr.addBackupTarget((root / L"incremental").wstring());
+    mgr.setIncrementalMode(true);
+    measure("incremental_initial");
+
+    BackupManifest manifest;
+    before = g_allocations.load();
+    bool loaded = manifest.load((root / L"incremental" / L"src Backup" / MANIFEST_FILE_NAME).wstring());
+    unsigned long long loadCount = g_allocations.load() - before;
+    const double loadPerFile = opt.files > 0 ? (double)loadCount / opt.files : 0.0;
+    std::printf("{\"bench\":\"alloc\",\"case\":\"manifest_load\",\"entries\":%zu,\"allocations\":%llu,\"per_file\":%.2f}\n",
+                manifest.size(), loadCount, loadPerFile);
+    Expect(loaded && manifest.size() == tree.files.size(), "alloc manifest_load: manifest missing after initial run");
+
+    Expect(measure("incremental_noop") <= iteratePerFile + loadPerFile + NOOP_EXTRA_ALLOCATIONS_PER_FILE,
+           "alloc incremental_noop: per-file allocations beyond iteration and manifest load");
+
+    std::error_code ec;
+    std::filesystem::remove_all(root, ec);
+}
+
+// 以下几项不计时，只检查结果是否正确，输入固定，每次运行结果相同
+
+// 时间轮：跨过层边界的定时器在正确的刻度到期，下放到下层之后仍能取消
+void CheckTimerWheel() {
+    const int before = g_failures;
+    const uint64_t tick = 100;
+    std::vector<uint64_t> expired;
+    auto expiresAt = [&](TimerWheel& wheel, uint64_t id, uint64_t dueTick) {
+        // 到期前一毫秒还没到，恰好到期的刻度上到
+        expired.clear();
+        wheel.advance(dueTick * tick - 1, expired);
+        bool early = std::find(expired.begin(), expired.end(), id) != expired.end();
+        wheel.advance(dueTick * tick, expired);
+        return !early && std::find(expired.begin(), expired.end(), id) != expired.end();
+    };
+
+    TimerWheel wheel((uint32_t)tick);
+    wheel.reset(0);
+    wheel.advance(60 * tick, expired);  // 停在第 0 层一圈快结束的地方
+
+    // 第 0 层内跨过 64 的边界：60 + 10 = 70
+    wheel.add(1, 10 * tick);
+    Expect(expiresAt(wheel, 1, 70), "timerwheel: level-0 timer across the 64-tick boundary");
+
+    // 相差 64 个刻度以上的放在第 1 层，第 128 刻度下放：70 + 70 = 140
+    wheel.add(2, 70 * tick);
+    Expect(expiresAt(wheel, 2, 140), "timerwheel: level-1 timer cascades and fires on its tick");
+
+    // 放在第 2 层，第 4096 刻度下放到第 1 层，第 5120 刻度再到第 0 层：140 + 5000 = 5140
+    wheel.add(3, 5000 * tick);
+    Expect(expiresAt(wheel, 3, 5140), "timerwheel: level-2 timer cascades twice and fires on its tick");
+
+    // 下放之后取消：5140 + 100 = 5240，第 5184 刻度下放到第 0 层
+    wheel.add(4, 100 * tick);
+    expired.clear();
+    wheel.advance(5200 * tick, expired);
+    Expect(expired.empty() && wheel.size() == 1, "timerwheel: timer expired before its tick");
+    Expect(wheel.cancel(4) && wheel.size() == 0, "timerwheel: cancel after cascade");
+    Expect(!wheel.cancel(4), "timerwheel: second cancel reports nothing to cancel");
+    wheel.advance(6000 * tick, expired);
+    Expect(expired.empty(), "timerwheel: cancelled timer still fired");
+
+    // 同一个 id 重新 add 替换原来的定时器
+    wheel.add(5, 10 * tick);
+    wheel.add(5, 20 * tick);
+    Expect(wheel.size() == 1 && expiresAt(wheel, 5, 6020), "timerwheel: re-adding an id replaces its timer");
+
+    std::printf("{\"bench\":\"check\",\"case\":\"timerwheel\",\"ok\":%s}\n", g_failures == before ? "true" : "false");
+}
+
+// 分级保留：每一级的时间桶里只留最新的一个，超出最后一级的删除，最新的版本总是保留。
+// 时间按本地时间取整点，选在不跨夏令时切换的七月，结果与所在时区无关
+void CheckRetentionTiers() {
+    const int before = g_failures;
+    std::tm local{};
+    local.tm_year = 2025 - 1900;
+    local.tm_mon = 6;
+    local.tm_mday = 16;
+    local.tm_hour = 12;
+    local.tm_isdst = -1;
+    const long long now = (long long)std::mktime(&local);
+    const long long minute = 60, hour = 3600, day = 24 * hour;
+
+    RetentionPolicy policy;
+    policy.keepAllHours = 2;
+    policy.hourlyDays = 2;
+    policy.dailyWeeks = 2;
+
+    // 距 now 的秒数，从旧到新
+    struct Case { long long age; bool kept; };
+    const Case cases[] = {
+        { 20 * day, false },                  // 超过最后一级（2 小时 + 2 天 + 2 周）
+        { 3 * day + 2 * hour, false },        // 三天前 10:00，同一天还有更新的
+        { 3 * day - 3 * hour, true },         // 三天前 15:00，当天最新
+        { 200 * minute, true },               // 08:40，这个小时只有它
+        { 170 * minute, false },              // 09:10，同一小时还有 09:30
+        { 150 * minute, true },               // 09:30
+        { 90 * minute, true },                // 两小时内全部保留
+        { 30 * minute, true },
+    };
+
+    RetentionIndex index;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        BackupVersion v;
+        v.name = L"v" + std::to_wstring(i);
+        v.time = now - cases[i].age;
+        v.bytes = 1;
+        index.add(v);
+    }
+    auto expired = index.takeExpired(policy, now);
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        const std::wstring name = L"v" + std::to_wstring(i);
+        bool gone = std::any_of(expired.begin(), expired.end(), [&](const BackupVersion& v) { return v.name == name; });
+        if (gone == cases[i].kept) {
+            char what[96];
+            std::snprintf(what, sizeof(what), "retention: version %zu should be %s", i, cases[i].kept ? "kept" : "expired");
+            Expect(false, what);
+        }
+    }
+    Expect(index.size() == 5, "retention: wrong number of versions left in the index");
+
+    // 再次调用不应删除更多；全部过期时仍保留最新的一个
+    Expect(index.takeExpired(policy, now).empty(), "retention: second pass expired more versions");
+    Expect(index.takeExpired(policy, now + 365 * day).size() == 4 && index.size() == 1,
+           "retention: newest version must survive when everything is past the last tier");
+
+    std::printf("{\"bench\":\"check\",\"case\":\"retention\",\"ok\":%s}\n", g_failures == before ? "true" : "false");
+}
+
+// 直方图：分位数返回所在桶的上界，小于 16 的值精确，其余相对误差不超过 1/16，桶的上界随取值单调不减
+void CheckHistogram() {
+    const int before = g_failures;
+    MetricHistogram h;
+
+    // 单独记录 value 时它所在桶的上界：再记一个最大值，中位数落在 value 的桶，不会被最大值截断
+    auto upperOf = [&](uint64_t value) {
+        h.reset();
+        h.record(value);
+        h.record(UINT64_MAX);
+        return h.valueAt(0.5);
+    };
+
+    bool exact = true, bounded = true, monotonic = true;
+    for (uint64_t v = 0; v < 16; ++v) exact = exact && upperOf(v) == v;
+
+    std::vector<uint64_t> values;
+    for (int bit = 4; bit < 63; ++bit) {
+        uint64_t p = 1ULL << bit;
+        values.push_back(p - 1);
+        values.push_back(p);
+        values.push_back(p + 1);
+        values.push_back(p + p / 2);
+    }
+    uint64_t previous = 0;
+    for (uint64_t v : values) {
+        uint64_t upper = upperOf(v);
+        bounded = bounded && upper >= v && upper - v <= v / 16;
+        monotonic = monotonic && upper >= previous;
+        previous = upper;
+    }
+    Expect(exact, "histogram: values below 16 must be exact");
+    Expect(bounded, "histogram: bucket upper bound outside [v, v + v/16]");
+    Expect(monotonic, "histogram: bucket upper bounds are not monotonic");
+
+    Expect(upperOf(1000) == 1023, "histogram: 1000 should fall in the [992, 1023] bucket");
+    Expect(upperOf(UINT64_MAX - 1) == UINT64_MAX, "histogram: top bucket must reach UINT64_MAX");
+
+    h.reset();
+    for (uint64_t v = 1; v <= 100; ++v) h.record(v);
+    Expect(h.count() == 100 && h.sum() == 5050 && h.maximum() == 100, "histogram: count/sum/max");
+    Expect(h.valueAt(1.0) == 100 && h.valueAt(0) == 1, "histogram: quantile 0 and 1");
+    uint64_t p50 = h.valueAt(0.5);
+    Expect(p50 >= 50 && p50 <= 53, "histogram: p50 of 1..100");
+
+    std::printf("{\"bench\":\"check\",\"case\":\"histogram\",\"ok\":%s}\n", g_failures == before ? "true" : "false");
+}
+
+// 日志窗口模型：按界面刷新节奏成批追加，测每行的平均开销以及缓冲写满后的情况
+void BenchLogView() {
+    const size_t capacity = 5000;
+    const int totalLines = 1000000;
+    const int batchSizes[] = { 1, 100, 10000 };
+
+    for (int batch : batchSizes) {
+        LogViewModel model(capacity);
+        size_t evictedTotal = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < totalLines; i += batch) {
+            for (int j = 0; j < batch; ++j) {
+                model.post(L"[2025-01-01 12:00:00] [增量备份] 更新文件: D:\\Backup\\docs\\file" + std::to_wstring(i + j) + L".txt");
+            }
+            size_t evicted = 0;
+            model.commit(&evicted);
+            evictedTotal += evicted;
+        }
+        double ms = ElapsedMs(start);
+
+        std::printf("{\"bench\":\"logview\",\"batch\":%d,\"lines\":%d,\"capacity\":%zu,\"kept\":%zu,"
+                    "\"evicted\":%zu,\"total_ms\":%.3f,\"ns_per_line\":%.1f}\n",
+                    batch, totalLines, capacity, model.size(), evictedTotal, ms, ms * 1e6 / totalLines);
+    }
+}
+
+} // namespace
+
+int wmain(int argc, wchar_t* argv[]) {
+    BenchOptions opt;
+    wchar_t tempBuf[MAX_PATH] = {0};
+    GetTempPathW(MAX_PATH, tempBuf);
+    opt.dir = std::wstring(tempBuf) + L"dab_bench";
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::wstring key = argv[i];
+        if (key == L"--files") opt.files = _wtoi(argv[i + 1]);
+        else if (key == L"--size") opt.fileSize = _wtoi64(argv[i + 1]);
+        else if (key == L"--depth") opt.depth = _wtoi(argv[i + 1]);
+        else if (key == L"--fanout") opt.fanout = _wtoi(argv[i + 1]);
+        else if (key == L"--mutate") opt.mutatePercent = _wtof(argv[i + 1]);
+        else if (key == L"--seed") opt.seed = (unsigned)_wtoi(argv[i + 1]);
+        else if (key == L"--versions") opt.versions = _wtoi(argv[i + 1]);
+        else if (key == L"--changes") opt.changes = _wtoi(argv[i + 1]);
+        else if (key == L"--change-interval") opt.changeIntervalMs = _wtoi(argv[i + 1]);
+        else if (key == L"--poll-ms") opt.pollMs = _wtoi(argv[i + 1]);
+        else if (key == L"--stop-mb") opt.stopFileMB = std::max(1, _wtoi(argv[i + 1]));
+        else if (key == L"--dir") opt.dir = argv[i + 1];
+    }
+
+    CheckTimerWheel();
+    CheckRetentionTiers();
+    CheckHistogram();
+
+    std::filesystem::create_directories(opt.dir);
+    BenchDurability(opt);
+    BenchLogView();
+    BenchAllocations(opt);
+    BenchTree(opt);
+    BenchLatency(opt, false);
+    BenchLatency(opt, true);
+    BenchStop(opt);
+    return g_failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,290 @@
+#include "config.h"
+#include "backup.h"
+#include <windows.h>
+#include <shlwapi.h>
+#include <string>
+#include <vector>
+
+std::wstring GetExeDirectory() {
+    wchar_t buffer[MAX_PATH];
+    GetModuleFileNameW(NULL, buffer, MAX_PATH);
+    PathRemoveFileSpecW(buffer);
+    return buffer;
+}
+
+std::wstring DefaultConfigPath() {
+    return GetExeDirectory() + L"\\config.ini";
+}
+
+void TrimTrailingNewlines(std::wstring& str) {
+    while (!str.empty() && (str.back() == L'\n' || str.back() == L'\r')) {
+        str.pop_back();
+    }
+}
+
+std::vector<std::wstring> SplitLines(const std::wstring& str) {
+    std::vector<std::wstring> result;
+    size_t start = 0;
+    while (true) {
+        size_t pos = str.find(L'\n', start);
+        std::wstring line;
+        if (pos == std::wstring::npos) {
+            line = str.substr(start);
+        } else {
+            line = str.substr(start, pos - start);
+        }
+
+        if (!line.empty() && line.back() == L'\r') {
+            line.pop_back();
+        }
+
+        if (!line.empty()) {
+            result.push_back(line);
+        }
+
+        if (pos == std::wstring::npos) {
+            break;
+        }
+        start = pos + 1;
+    }
+    return result;
+}
+
+bool SaveConfig(const std::wstring& path, const BackupManager& mgr,
+                const std::wstring& sourcePath, const std::wstring& targetsMultiLine) {
+    std::wstring pollingLine = mgr.pollingMode ? L"POLLING=1" : L"POLLING=0";
+    std::wstring increLine = mgr.incrementalMode ? L"INCREMENTAL=1" : L"INCREMENTAL=0";
+    std::wstring pollingIntervalLine = L"POLLING_INTERVAL=" + std::to_wstring(mgr.pollingInterval);
+    std::wstring maxBackupCount = L"MAX_BACKUP_COUNT=" + std::to_wstring(mgr.maxBackupCount); //1.3.0 最大备份数
+    const RetentionPolicy& policy = mgr.retentionPolicy;
+    std::wstring retentionLines = L"RETENTION_ALL_HOURS=" + std::to_wstring(policy.keepAllHours) + L"\n"
+                                + L"RETENTION_HOURLY_DAYS=" + std::to_wstring(policy.hourlyDays) + L"\n"
+                                + L"RETENTION_DAILY_WEEKS=" + std::to_wstring(policy.dailyWeeks) + L"\n"
+                                + L"RETENTION_WEEKLY_MONTHS=" + std::to_wstring(policy.weeklyMonths);
+    std::wstring quotaLine = L"QUOTA_MB=" + std::to_wstring(mgr.quotaMB);
+    std::wstring traceLine = mgr.traceEnabled ? L"TRACE=1" : L"TRACE=0";
+    std::wstring metricsLine = L"METRICS_FILE=" + mgr.metricsFile;
+    std::wstring lowPriorityLine = mgr.lowPriority ? L"LOW_PRIORITY=1" : L"LOW_PRIORITY=0";
+    const LoadLimits& load = mgr.loadLimits;
+    std::wstring loadLines = std::wstring(L"LOAD_GATE=") + (load.enabled ? L"1" : L"0") + L"\n"
+                           + L"LOAD_CPU=" + std::to_wstring(load.cpuPercent) + L"\n"
+                           + L"LOAD_DISK_QUEUE=" + std::to_wstring(load.diskQueue) + L"\n"
+                           + L"LOAD_ON_BATTERY=" + (load.deferOnBattery ? L"1" : L"0") + L"\n"
+                           + L"LOAD_MAX_DEFER=" + std::to_wstring(load.maxDeferSeconds);
+    std::wstring logLevelLine = std::wstring(L"LOG_LEVEL=") + LogLevelName(mgr.logLevel);
+    const LogRotation& rotation = mgr.logRotation;
+    std::wstring rotationLines = L"LOG_MAX_MB=" + std::to_wstring(rotation.maxBytes / (1024 * 1024)) + L"\n"
+                               + L"LOG_MAX_DAYS=" + std::to_wstring(rotation.maxAgeDays) + L"\n"
+                               + L"LOG_KEEP=" + std::to_wstring(rotation.keepArchives);
+
+    std::wstring content = sourcePath + L"\n" 
+                        + targetsMultiLine + L"\n" 
+                        + pollingLine + L"\n" 
+                        + increLine + L"\n"
+                        + pollingIntervalLine + L"\n"
+                        + maxBackupCount + L"\n"
+                        + retentionLines + L"\n"
+                        + quotaLine + L"\n"
+                        + logLevelLine + L"\n"
+                        + rotationLines + L"\n"
+                        + traceLine + L"\n"
+                        + metricsLine + L"\n"
+                        + lowPriorityLine + L"\n"
+                        + loadLines + L"\n";
+
+    HANDLE hFile = CreateFileW(
+        path.c_str(),
+        GENERIC_WRITE,
+        0,
+        NULL,
+        CREATE_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL,
+        NULL
+    );
+
+    if (hFile == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    bool ok = true;
+    DWORD written = 0;
+    int len = WideCharToMultiByte(CP_UTF8, 0, content.c_str(), -1, NULL, 0, NULL, NULL);
+    if (len > 1) {
+        std::string utf8(len - 1, '\0');
+        WideCharToMultiByte(CP_UTF8, 0, content.c_str(), -1, &utf8[0], len, NULL, NULL);
+        ok = WriteFile(hFile, utf8.c_str(), (DWORD)utf8.size(), &written, NULL) && written == utf8.size();
+    }
+    CloseHandle(hFile);
+    return ok;
+}
+
+bool ReadTextLines(const std::wstring& path, std::vector<std::wstring>& lines) {
+    HANDLE hFile = CreateFileW(
+        path.c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        NULL,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        NULL
+    );
+
+    if (hFile == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    DWORD fileSize = GetFileSize(hFile, NULL);
+    if (fileSize == INVALID_FILE_SIZE || fileSize == 0) {
+        CloseHandle(hFile);
+        return false;
+    }
+
+    std::string utf8Data(fileSize, '\0');
+    DWORD bytesRead;
+    ReadFile(hFile, &utf8Data[0], fileSize, &bytesRead, NULL);
+    CloseHandle(hFile);
+
+    int wideLen = MultiByteToWideChar(CP_UTF8, 0, utf8Data.c_str(), -1, NULL, 0);
+    if (wideLen <= 0) return false;
+    std::wstring wContent(wideLen, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, utf8Data.c_str(), -1, &wContent[0], wideLen);
+
+    if (!wContent.empty() && wContent.back() == L'\0') {
+        wContent.pop_back();
+    }
+
+    // 拆分为多行
+    lines.clear();
+    size_t start = 0, end = 0;
+    while ((end = wContent.find(L'\n', start)) != std::wstring::npos) {
+        std::wstring line = wContent.substr(start, end - start);
+        TrimTrailingNewlines(line);
+        lines.push_back(line);
+        start = end + 1;
+    }
+    if (start < wContent.size()) {
+        std::wstring line = wContent.substr(start);
+        TrimTrailingNewlines(line);
+        lines.push_back(line);
+    }
+
+    return true;
+}
+
+bool LoadConfig(const std::wstring& path, BackupManager& mgr,
+                std::wstring& sourcePath, std::wstring& targetsMultiLine) {
+    std::vector<std::wstring> lines;
+    if (!ReadTextLines(path, lines)) {
+        sourcePath.clear();
+        targetsMultiLine.clear();
+        return false;
+    }
+
+    // 解析 sourcePath
+    if (!lines.empty()) sourcePath = lines[0];
+
+    // 解析目标路径们（从第2行开始，一直到遇到关键词行为止）
+    targetsMultiLine.clear();
+    size_t i = 1;
+    for (; i < lines.size(); ++i) {
+        if (lines[i].find(L"POLLING=") == 0 ||
+            lines[i].find(L"INCREMENTAL=") == 0 ||
+            lines[i].find(L"POLLING_INTERVAL=") == 0 ||
+            lines[i].find(L"MAX_BACKUP_COUNT=") == 0 ||
+            lines[i].find(L"RETENTION_") == 0 ||
+            lines[i].find(L"QUOTA_MB=") == 0 ||
+            lines[i].find(L"LOG_") == 0 ||
+            lines[i].find(L"TRACE=") == 0 ||
+            lines[i].find(L"METRICS_FILE=") == 0 ||
+            lines[i].find(L"LOW_PRIORITY=") == 0 ||
+            lines[i].find(L"LOAD_") == 0) {
+            break;
+        }
+        targetsMultiLine += lines[i] + L"\r\n";
+    }
+
+    // 后续行为设置项
+    for (; i < lines.size(); ++i) {
+        const std::wstring& line = lines[i];
+        if (line.find(L"POLLING=") == 0) {
+            mgr.setPollingMode(line == L"POLLING=1");
+        } else if (line.find(L"INCREMENTAL=")==0) {
+            mgr.setIncrementalMode(line == L"INCREMENTAL=1");
+        } else if (line.find(L"POLLING_INTERVAL=") == 0) {
+            try {
+                int val = std::stoi(line.substr(17)); // 17 = strlen("POLLING_INTERVAL=")
+                mgr.setPollingInterval(val);
+            } catch (...) {
+                mgr.setPollingInterval(3000); // 默认值
+            }
+        } else if (line.find(L"MAX_BACKUP_COUNT=") == 0) {
+            try {
+                int val = std::stoi(line.substr(17)); // 17 = strlen("MAX_BACKUP_COUNT=")
+                mgr.setMaxBackupCount(val);
+            } catch (...) {
+                mgr.setMaxBackupCount(10); // 默认值
+            }
+        } else if (line.find(L"RETENTION_") == 0) {
+            // 分级保留策略，例如 RETENTION_HOURLY_DAYS=7
+            size_t eq = line.find(L'=');
+            if (eq == std::wstring::npos) continue;
+            std::wstring key = line.substr(0, eq);
+            int val = _wtoi(line.c_str() + eq + 1);
+            if (val < 0) val = 0;
+
+            RetentionPolicy policy = mgr.retentionPolicy;
+            if (key == L"RETENTION_ALL_HOURS") policy.keepAllHours = val;
+            else if (key == L"RETENTION_HOURLY_DAYS") policy.hourlyDays = val;
+            else if (key == L"RETENTION_DAILY_WEEKS") policy.dailyWeeks = val;
+            else if (key == L"RETENTION_WEEKLY_MONTHS") policy.weeklyMonths = val;
+            mgr.setRetentionPolicy(policy);
+        } else if (line.find(L"QUOTA_MB=") == 0) {
+            // 每个目标的备份占用上限，0 表示不限制
+            int val = _wtoi(line.c_str() + 9); // 9 = strlen("QUOTA_MB=")
+            mgr.setQuotaMB(val > 0 ? val : 0);
+        } else if (line.find(L"LOG_LEVEL=") == 0) {
+            // debug 时才逐文件记录，平时每次备份每个目标只有一行汇总
+            mgr.setLogLevel(ParseLogLevel(line.substr(10))); // 10 = strlen("LOG_LEVEL=")
+        } else if (line.find(L"LOG_MAX_MB=") == 0 || line.find(L"LOG_MAX_DAYS=") == 0 || line.find(L"LOG_KEEP=") == 0) {
+            // 日志轮转，backup.log 和 gui.log（或 daemon.log）使用同一套设置
+            size_t eq = line.find(L'=');
+            std::wstring key = line.substr(0, eq);
+            int val = _wtoi(line.c_str() + eq + 1);
+            if (val < 0) val = 0;
+
+            LogRotation rotation = mgr.logRotation;
+            if (key == L"LOG_MAX_MB") rotation.maxBytes = (unsigned long long)val * 1024 * 1024;
+            else if (key == L"LOG_MAX_DAYS") rotation.maxAgeDays = val;
+            else if (key == L"LOG_KEEP") rotation.keepArchives = val;
+            mgr.setLogRotation(rotation);
+        } else if (line.find(L"TRACE=") == 0) {
+            // 记录各步骤的耗时跟踪；停止监听、退出界面或守护进程收到 trace 命令时写入 backup.trace，用 traceview.exe 查看
+            mgr.setTraceEnabled(line == L"TRACE=1");
+        } else if (line.find(L"METRICS_FILE=") == 0) {
+            // 每次备份后写入 Prometheus 文本格式的指标（例如 node_exporter 的 textfile 目录），为空时不写
+            mgr.setMetricsFile(line.substr(13)); // 13 = strlen("METRICS_FILE=")
+        } else if (line.find(L"LOW_PRIORITY=") == 0) {
+            // 备份时降低 CPU 与磁盘 I/O 优先级，不和前台程序争抢同一块磁盘
+            mgr.setLowPriority(line != L"LOW_PRIORITY=0");
+        } else if (line.find(L"LOAD_") == 0) {
+            // 系统繁忙（CPU、磁盘队列、电池供电）时推迟自动备份，最多推迟 LOAD_MAX_DEFER 秒
+            size_t eq = line.find(L'=');
+            if (eq == std::wstring::npos) continue;
+            std::wstring key = line.substr(0, eq);
+            int val = _wtoi(line.c_str() + eq + 1);
+            if (val < 0) val = 0;
+
+            LoadLimits load = mgr.loadLimits;
+            if (key == L"LOAD_GATE") load.enabled = val != 0;
+            else if (key == L"LOAD_CPU") load.cpuPercent = val;
+            else if (key == L"LOAD_DISK_QUEUE") load.diskQueue = val;
+            else if (key == L"LOAD_ON_BATTERY") load.deferOnBattery = val != 0;
+            else if (key == L"LOAD_MAX_DEFER") load.maxDeferSeconds = val;
+            mgr.setLoadLimits(load);
+        }
+    }
+
+    TrimTrailingNewlines(sourcePath);
+    TrimTrailingNewlines(targetsMultiLine);
+    return true;
+}
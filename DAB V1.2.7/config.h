@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+class BackupManager;
+
+// config.ini 的读写，界面和无界面（--daemon）两种运行方式共用。
+// 格式：第一行为源路径，之后每行一个目标路径，直到第一个 KEY=VALUE 设置项为止，之后都是设置项。
+
+std::wstring GetExeDirectory();
+
+// 默认的配置文件：程序目录下的 config.ini
+std::wstring DefaultConfigPath();
+
+void TrimTrailingNewlines(std::wstring& str);
+
+// 按行拆分，去掉行尾的 \r 和空行
+std::vector<std::wstring> SplitLines(const std::wstring& str);
+
+// 读取 UTF-8 文本文件并按行拆分（保留空行）；文件不存在、为空或无法读取时返回 false
+bool ReadTextLines(const std::wstring& path, std::vector<std::wstring>& lines);
+
+// 设置项直接写入 mgr；targetsMultiLine 为以 \r\n 分隔的目标路径。文件不存在或无法读取时返回 false
+bool LoadConfig(const std::wstring& path, BackupManager& mgr,
+                std::wstring& sourcePath, std::wstring& targetsMultiLine);
+
+bool SaveConfig(const std::wstring& path, const BackupManager& mgr,
+                const std::wstring& sourcePath, const std::wstring& targetsMultiLine);
@@ -0,0 +1,453 @@
+#include "copyengine.h"
+#include "trace.h"
+#include <windows.h>
+#include <vector>
+#include <algorithm>
+#include <cwctype>
+#include <unordered_map>
+#include <string_view>
+
+namespace {
+
+const DWORD COPY_CHUNK_SIZE = 1024 * 1024;                          // 每次读写 1MB
+const unsigned long long CHECKPOINT_INTERVAL = 64ULL * 1024 * 1024; // 每写入 64MB 保存一次检查点
+const uint32_t CHECKPOINT_MAGIC = 0x43424144;                       // "DABC"
+const uint32_t CHECKPOINT_VERSION = 1;
+
+#pragma pack(push, 1)
+struct CopyCheckpoint {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t srcSize;       // 源文件大小
+    uint64_t srcWriteTime;  // 源文件最后修改时间（FILETIME）
+    uint64_t offset;        // 已确认落盘的字节数
+    uint64_t hash;          // [0, offset) 内容的 FNV-1a 哈希
+};
+#pragma pack(pop)
+
+uint64_t FileTimeToU64(const FILETIME& ft) {
+    return (uint64_t(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+}
+
+bool SeekTo(HANDLE h, unsigned long long pos) {
+    LARGE_INTEGER li;
+    li.QuadPart = (LONGLONG)pos;
+    return SetFilePointerEx(h, li, NULL, FILE_BEGIN) != 0;
+}
+
+// 暂存文件名只和源路径有关，这样完整备份模式下目标文件名带时间戳也能续传
+std::wstring StagingBaseName(const std::wstring& src) {
+    std::wstring lower = src;
+    std::transform(lower.begin(), lower.end(), lower.begin(),
+        [](wchar_t c) { return std::towlower(c); });
+    uint64_t h = Fnv1a64(lower.data(), lower.size() * sizeof(wchar_t));
+
+    wchar_t buf[17];
+    swprintf(buf, 17, L"%016llx", (unsigned long long)h);
+    return buf;
+}
+
+bool ReadCheckpoint(HANDLE hCkpt, CopyCheckpoint& ckpt) {
+    DWORD bytesRead = 0;
+    if (!SeekTo(hCkpt, 0)) return false;
+    if (!ReadFile(hCkpt, &ckpt, sizeof(ckpt), &bytesRead, NULL) || bytesRead != sizeof(ckpt)) return false;
+    return ckpt.magic == CHECKPOINT_MAGIC && ckpt.version == CHECKPOINT_VERSION;
+}
+
+bool WriteCheckpoint(HANDLE hCkpt, const CopyCheckpoint& ckpt) {
+    DWORD written = 0;
+    if (!SeekTo(hCkpt, 0)) return false;
+    if (!WriteFile(hCkpt, &ckpt, sizeof(ckpt), &written, NULL) || written != sizeof(ckpt)) return false;
+    return FlushFileBuffers(hCkpt) != 0;
+}
+
+// 一段需要拷贝的数据区间（稀疏文件中的空洞不在其中）
+struct DataRange {
+    unsigned long long offset;
+    unsigned long long length;
+};
+
+// 普通文件返回 [0, size)；稀疏文件通过 FSCTL_QUERY_ALLOCATED_RANGES 只返回已分配的区段
+void QueryDataRanges(HANDLE hSrc, unsigned long long size, bool sparse, std::vector<DataRange>& ranges) {
+    ranges.clear();
+    if (size == 0) return;
+    if (!sparse) {
+        ranges.push_back({ 0, size });
+        return;
+    }
+
+    FILE_ALLOCATED_RANGE_BUFFER query;
+    query.FileOffset.QuadPart = 0;
+    query.Length.QuadPart = (LONGLONG)size;
+    FILE_ALLOCATED_RANGE_BUFFER out[64];
+
+    for (;;) {
+        DWORD bytes = 0;
+        BOOL done = DeviceIoControl(hSrc, FSCTL_QUERY_ALLOCATED_RANGES, &query, sizeof(query),
+                                    out, sizeof(out), &bytes, NULL);
+        if (!done && GetLastError() != ERROR_MORE_DATA) {
+            // 文件系统不支持查询时按普通文件整体拷贝
+            ranges.assign(1, { 0, size });
+            return;
+        }
+
+        DWORD count = bytes / sizeof(FILE_ALLOCATED_RANGE_BUFFER);
+        for (DWORD i = 0; i < count; ++i) {
+            unsigned long long off = (unsigned long long)out[i].FileOffset.QuadPart;
+            unsigned long long len = (unsigned long long)out[i].Length.QuadPart;
+            if (off >= size) continue;
+            ranges.push_back({ off, std::min(len, size - off) });
+        }
+        if (done || count == 0) break;
+
+        unsigned long long next = ranges.back().offset + ranges.back().length;
+        query.FileOffset.QuadPart = (LONGLONG)next;
+        query.Length.QuadPart = (LONGLONG)(size - next);
+    }
+}
+
+// 稀疏源文件：把目标也标记为稀疏，空洞不写入即可保持不占空间；
+// 普通文件：一次性预分配全部空间，减少机械硬盘上的碎片
+void PrepareDestination(HANDLE hDst, unsigned long long size, bool sparse) {
+    if (sparse) {
+        DWORD bytes = 0;
+        DeviceIoControl(hDst, FSCTL_SET_SPARSE, NULL, 0, NULL, 0, &bytes, NULL);
+    } else {
+        FILE_ALLOCATION_INFO alloc;
+        alloc.AllocationSize.QuadPart = (LONGLONG)size;
+        SetFileInformationByHandle(hDst, FileAllocationInfo, &alloc, sizeof(alloc));
+    }
+}
+
+// 校验暂存文件中 [0, offset) 内各数据区段的哈希是否与检查点一致
+bool VerifyPartial(HANDLE hPart, const std::vector<DataRange>& ranges, const CopyCheckpoint& ckpt,
+                   std::vector<BYTE>& buffer) {
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(hPart, &size) || (unsigned long long)size.QuadPart < ckpt.offset) return false;
+
+    uint64_t hash = FNV1A64_INIT;
+    for (const auto& r : ranges) {
+        if (r.offset >= ckpt.offset) break;
+        unsigned long long pos = r.offset;
+        unsigned long long end = std::min(r.offset + r.length, (unsigned long long)ckpt.offset);
+        if (!SeekTo(hPart, pos)) return false;
+        while (pos < end) {
+            DWORD toRead = (DWORD)std::min<unsigned long long>(end - pos, buffer.size());
+            DWORD bytesRead = 0;
+            if (!ReadFile(hPart, buffer.data(), toRead, &bytesRead, NULL) || bytesRead != toRead) return false;
+            hash = Fnv1a64(buffer.data(), bytesRead, hash);
+            pos += bytesRead;
+        }
+    }
+    return hash == ckpt.hash;
+}
+
+bool CopyCancelled(const CopyResult* control) {
+    if (control && control->cancel && control->cancel->load(std::memory_order_relaxed)) {
+        SetLastError(ERROR_CANCELLED);
+        return true;
+    }
+    return false;
+}
+
+void ReportProgress(const CopyResult* control, unsigned long long bytes) {
+    if (control && control->progressBytes && bytes > 0) {
+        control->progressBytes->fetch_add(bytes, std::memory_order_relaxed);
+    }
+}
+
+// 从 ckpt.offset 开始依次拷贝各数据区段；hCkpt 有效时每写入一段固定大小就保存一次检查点。
+// control 可以为空，非空时每个数据块之前检查取消并汇报进度。
+// 源文件在拷贝过程中被截短时返回 false 且错误码为 ERROR_HANDLE_EOF
+bool CopyRanges(HANDLE hSrc, HANDLE hDst, const std::vector<DataRange>& ranges,
+                CopyCheckpoint& ckpt, HANDLE hCkpt, std::vector<BYTE>& buffer, const CopyResult* control) {
+    unsigned long long sinceCheckpoint = 0;
+    for (const auto& r : ranges) {
+        unsigned long long end = r.offset + r.length;
+        if (end <= ckpt.offset) continue;
+
+        unsigned long long pos = std::max(r.offset, (unsigned long long)ckpt.offset);
+        if (!SeekTo(hSrc, pos) || !SeekTo(hDst, pos)) return false;
+
+        while (pos < end) {
+            if (CopyCancelled(control)) return false;
+
+            DWORD toRead = (DWORD)std::min<unsigned long long>(end - pos, buffer.size());
+            DWORD bytesRead = 0;
+            if (!ReadFile(hSrc, buffer.data(), toRead, &bytesRead, NULL)) return false;
+            if (bytesRead == 0) {
+                // 源文件在拷贝过程中被截短：不能补零凑成原来的大小当作有效备份
+                SetLastError(ERROR_HANDLE_EOF);
+                return false;
+            }
+
+            DWORD written = 0;
+            if (!WriteFile(hDst, buffer.data(), bytesRead, &written, NULL) || written != bytesRead) return false;
+            ckpt.hash = Fnv1a64(buffer.data(), bytesRead, ckpt.hash);
+            pos += bytesRead;
+            ckpt.offset = pos;
+            sinceCheckpoint += bytesRead;
+            ReportProgress(control, bytesRead);
+
+            // 先让数据落盘再更新检查点，保证检查点记录的偏移之前的内容一定有效
+            if (hCkpt != INVALID_HANDLE_VALUE && sinceCheckpoint >= CHECKPOINT_INTERVAL) {
+                if (!FlushFileBuffers(hDst) || !WriteCheckpoint(hCkpt, ckpt)) return false;
+                sinceCheckpoint = 0;
+            }
+        }
+    }
+    return true;
+}
+
+// CopyFileExW 的进度回调：汇报新拷贝的字节，取消时让系统中止拷贝并删除写了一半的目标
+struct CopyExProgress {
+    const CopyResult* control;
+    unsigned long long reported;
+};
+
+DWORD CALLBACK CopyExProgressRoutine(LARGE_INTEGER, LARGE_INTEGER transferred, LARGE_INTEGER, LARGE_INTEGER,
+                                     DWORD, DWORD, HANDLE, HANDLE, LPVOID data) {
+    CopyExProgress* p = (CopyExProgress*)data;
+    unsigned long long now = (unsigned long long)transferred.QuadPart;
+    ReportProgress(p->control, now - p->reported);
+    p->reported = now;
+    return CopyCancelled(p->control) ? PROGRESS_CANCEL : PROGRESS_CONTINUE;
+}
+
+bool FlushPath(const std::wstring& path) {
+    HANDLE h = CreateFileW(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                           OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (h == INVALID_HANDLE_VALUE) return false;
+    bool ok = FlushFileBuffers(h) != 0;
+    CloseHandle(h);
+    return ok;
+}
+
+// 自行分块拷贝：用于稀疏文件、大文件和需要内容哈希的文件（哈希在写入时顺带计算，不再回读目标）。
+// 大文件写入暂存目录并维护检查点以便续传，其余情况写入 dst 旁的临时文件。完成后改名到 dst。
+bool CopyFileStreamed(HANDLE hSrc, const BY_HANDLE_FILE_INFORMATION& info, const std::wstring& src,
+                      const std::wstring& dst, const std::wstring& stagingDir,
+                      DurabilityBatch* batch, CopyResult* result) {
+    const unsigned long long size = (uint64_t(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+    const bool sparse = (info.dwFileAttributes & FILE_ATTRIBUTE_SPARSE_FILE) != 0;
+    const bool resumable = size >= RESUMABLE_COPY_THRESHOLD;
+
+    std::vector<DataRange> ranges;
+    QueryDataRanges(hSrc, size, sparse, ranges);
+
+    std::wstring tmpPath = dst + TEMP_FILE_SUFFIX;
+    std::wstring ckptPath;
+    HANDLE hCkpt = INVALID_HANDLE_VALUE;
+    if (resumable) {
+        if (!CreateDirectoryW(stagingDir.c_str(), NULL) && GetLastError() != ERROR_ALREADY_EXISTS) return false;
+
+        const std::wstring base = stagingDir + L"\\" + StagingBaseName(src);
+        tmpPath = base + L".part";
+        ckptPath = base + L".ckpt";
+
+        hCkpt = CreateFileW(ckptPath.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL,
+                            OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (hCkpt == INVALID_HANDLE_VALUE) return false;
+    }
+
+    HANDLE hDst = CreateFileW(tmpPath.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL,
+                              resumable ? OPEN_ALWAYS : CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hDst == INVALID_HANDLE_VALUE) {
+        if (hCkpt != INVALID_HANDLE_VALUE) CloseHandle(hCkpt);
+        return false;
+    }
+
+    // 小文件不必占用整块缓冲
+    const size_t bufferSize = resumable ? COPY_CHUNK_SIZE
+                                        : (size_t)std::clamp<unsigned long long>(size, 1, COPY_CHUNK_SIZE);
+    std::vector<BYTE> buffer(bufferSize);
+
+    // 只有源文件未变化且已写入部分校验通过时才续传，否则从头开始
+    CopyCheckpoint ckpt = {};
+    bool resume = resumable &&
+                  ReadCheckpoint(hCkpt, ckpt) &&
+                  ckpt.srcSize == size &&
+                  ckpt.srcWriteTime == FileTimeToU64(info.ftLastWriteTime) &&
+                  ckpt.offset <= ckpt.srcSize &&
+                  VerifyPartial(hDst, ranges, ckpt, buffer);
+    if (!resume) {
+        ckpt = {};
+        ckpt.magic = CHECKPOINT_MAGIC;
+        ckpt.version = CHECKPOINT_VERSION;
+        ckpt.srcSize = size;
+        ckpt.srcWriteTime = FileTimeToU64(info.ftLastWriteTime);
+        ckpt.offset = 0;
+        ckpt.hash = FNV1A64_INIT;
+    }
+    if (result) result->resumedFrom = ckpt.offset;
+    ReportProgress(result, ckpt.offset);
+
+    bool ok = SeekTo(hDst, ckpt.offset) && SetEndOfFile(hDst);
+    if (ok) PrepareDestination(hDst, size, sparse);
+    if (ok && resumable && !resume) ok = WriteCheckpoint(hCkpt, ckpt);
+    bool truncated = false;
+    if (ok) {
+        ok = CopyRanges(hSrc, hDst, ranges, ckpt, hCkpt, buffer, result);
+        truncated = !ok && GetLastError() == ERROR_HANDLE_EOF;
+    }
+    if (ok) ok = SeekTo(hDst, size) && SetEndOfFile(hDst);  // 补齐末尾的空洞
+    if (ok) {
+        SetFileTime(hDst, NULL, NULL, &info.ftLastWriteTime);  // 与 CopyFileW 一样保留修改时间
+        if (batch && batch->perFileSync()) ok = FlushFileBuffers(hDst) != 0;
+    }
+
+    CloseHandle(hDst);
+    if (hCkpt != INVALID_HANDLE_VALUE) CloseHandle(hCkpt);
+    if (!ok) {
+        // 续传的暂存文件与检查点保留，下次从检查点继续；源文件被截短时已经不能续传，一并删除
+        if (!resumable || truncated) DeleteFileW(tmpPath.c_str());
+        if (truncated) {
+            DeleteFileW(ckptPath.c_str());
+            SetLastError(ERROR_HANDLE_EOF);
+        }
+        return false;
+    }
+
+    if (!MoveFileExW(tmpPath.c_str(), dst.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_COPY_ALLOWED)) {
+        if (!resumable) DeleteFileW(tmpPath.c_str());
+        return false;
+    }
+    if (resumable) DeleteFileW(ckptPath.c_str());
+    if (batch) batch->add(dst);
+    if (result) result->contentHash = ckpt.hash;
+    return true;
+}
+
+} // namespace
+
+uint64_t Fnv1a64(const void* data, size_t len, uint64_t seed) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    uint64_t h = seed;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+DurabilityBatch::DurabilityBatch(bool perFileSync) : perFile(perFileSync) {}
+
+void DurabilityBatch::add(const std::wstring& path) {
+    if (!perFile) files.push_back(arena.store(path));
+}
+
+bool DurabilityBatch::commit() {
+    if (files.empty()) return true;
+
+    // 同一批次通常都在一个目标卷上，按卷分组，每个卷刷新一次。
+    // 同一目录下的文件一定在同一个卷上，每个目录只查询一次卷路径
+    std::vector<std::wstring> volumes;
+    std::vector<const wchar_t*> fallback;
+    std::unordered_map<std::wstring_view, bool> dirResolved;  // 目录 -> 是否查到了卷路径
+    for (const wchar_t* f : files) {
+        std::wstring_view path(f);
+        std::wstring_view dir = path.substr(0, path.find_last_of(L"\\/"));
+        auto known = dirResolved.find(dir);
+        if (known == dirResolved.end()) {
+            wchar_t volume[MAX_PATH] = {0};
+            bool resolved = GetVolumePathNameW(f, volume, MAX_PATH) != 0;
+            if (resolved && std::find(volumes.begin(), volumes.end(), volume) == volumes.end()) {
+                volumes.push_back(volume);
+            }
+            known = dirResolved.emplace(dir, resolved).first;
+        }
+        if (!known->second) fallback.push_back(f);
+    }
+
+    bool ok = true;
+    for (auto& v : volumes) {
+        // "D:\" -> "\\.\D:"，刷新卷句柄会把该卷所有脏数据与元数据一起写回
+        std::wstring device = v;
+        if (!device.empty() && device.back() == L'\\') device.pop_back();
+        bool flushed = false;
+        if (device.size() == 2 && device[1] == L':') {
+            HANDLE hVol = CreateFileW((L"\\\\.\\" + device).c_str(), GENERIC_WRITE,
+                                      FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+            if (hVol != INVALID_HANDLE_VALUE) {
+                flushed = FlushFileBuffers(hVol) != 0;
+                CloseHandle(hVol);
+            }
+        }
+        if (!flushed) {
+            for (const wchar_t* f : files) {
+                if (_wcsnicmp(f, v.c_str(), v.size()) == 0) fallback.push_back(f);
+            }
+        }
+    }
+
+    for (const wchar_t* f : fallback) {
+        if (!FlushPath(f)) ok = false;
+    }
+    files.clear();
+    arena.reset();
+    return ok;
+}
+
+bool BackupCopyFile(const std::wstring& src, const std::wstring& dst, const std::wstring& stagingDir,
+                    DurabilityBatch* batch, CopyResult* result) {
+    if (result) {
+        result->resumedFrom = 0;
+        result->bytes = 0;
+        result->contentHash = 0;
+    }
+
+    if (CopyCancelled(result)) return false;
+
+    const uint32_t traceName = TraceEnabled() ? TraceName(src) : 0;
+    TraceSpan step(TraceEvent::Open, traceName);
+
+    HANDLE hSrc = CreateFileW(src.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (hSrc == INVALID_HANDLE_VALUE) return false;
+
+    BY_HANDLE_FILE_INFORMATION info;
+    if (!GetFileInformationByHandle(hSrc, &info)) {
+        CloseHandle(hSrc);
+        return false;
+    }
+
+    const unsigned long long size = (uint64_t(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+    const bool sparse = (info.dwFileAttributes & FILE_ATTRIBUTE_SPARSE_FILE) != 0;
+    if (result) result->bytes = size;
+
+    // 需要哈希时走自行分块拷贝，边写边算，避免拷贝完再把目标整个读一遍
+    if (!sparse && size < RESUMABLE_COPY_THRESHOLD && !(result && result->hashContent)) {
+        CloseHandle(hSrc);
+
+        // 先写临时文件，再原子地改名覆盖目标；临时文件名拼在每个线程复用的缓冲里
+        static thread_local std::wstring tmp;
+        tmp.assign(dst).append(TEMP_FILE_SUFFIX);
+        step.next(TraceEvent::Copy, size);
+        // 需要取消或进度时改用带回调的 CopyFileExW，回调在系统每拷贝一块数据后调用
+        CopyExProgress progress = { result, 0 };
+        bool watched = result && (result->cancel || result->progressBytes);
+        if (watched ? !CopyFileExW(src.c_str(), tmp.c_str(), CopyExProgressRoutine, &progress, NULL, 0)
+                    : !CopyFileW(src.c_str(), tmp.c_str(), FALSE)) {
+            return false;
+        }
+        step.next(TraceEvent::Close);
+        if (batch && batch->perFileSync() && !FlushPath(tmp)) {
+            DeleteFileW(tmp.c_str());
+            return false;
+        }
+        if (!MoveFileExW(tmp.c_str(), dst.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+            DeleteFileW(tmp.c_str());
+            return false;
+        }
+        if (batch) batch->add(dst);
+        if (size > progress.reported) ReportProgress(result, size - progress.reported);
+        return true;
+    }
+
+    // 自行分块拷贝时关闭和改名在 CopyFileStreamed 内部完成，一并计入 copy
+    step.next(TraceEvent::Copy, size);
+    bool ok = CopyFileStreamed(hSrc, info, src, dst, stagingDir, batch, result);
+    step.next(TraceEvent::Close);
+    CloseHandle(hSrc);
+    return ok;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <atomic>
+#include "patharena.h"
+
+// 超过该大小的文件走可续传拷贝，其余不需要内容哈希的非稀疏文件直接 CopyFileW
+const unsigned long long RESUMABLE_COPY_THRESHOLD = 64ULL * 1024 * 1024;
+
+// 原子替换用的临时文件后缀
+const wchar_t TEMP_FILE_SUFFIX[] = L".dabtmp";
+
+// 续传用的暂存目录名（位于每个目标的 "xxx Backup" 文件夹内）
+const wchar_t STAGING_DIR_NAME[] = L".dabpartial";
+
+const uint64_t FNV1A64_INIT = 14695981039346656037ULL;
+
+// FNV-1a 64 位哈希，可分块连续调用（把上一次的结果作为 seed 传入）
+uint64_t Fnv1a64(const void* data, size_t len, uint64_t seed = FNV1A64_INIT);
+
+// 一批拷贝的落盘控制。默认只记录本批写入的文件，在 commit() 时对整个目标卷
+// 统一刷一次盘；perFileSync 为 true 时退化为每个文件改名前各自 FlushFileBuffers。
+// 记录的路径存放在批次自己的内存池里，逐个文件登记时不再各自分配字符串。
+class DurabilityBatch {
+public:
+    explicit DurabilityBatch(bool perFileSync = false);
+
+    bool perFileSync() const { return perFile; }
+    void add(const std::wstring& path);
+    size_t size() const { return files.size(); }
+
+    // 让本批次写入的数据落盘：优先刷新整个卷（需要管理员权限），失败时逐个文件刷新
+    bool commit();
+
+private:
+    bool perFile;
+    PathArena arena;
+    std::vector<const wchar_t*> files;  // 指向 arena 中的路径
+};
+
+// 单个文件拷贝的附加输入/输出
+struct CopyResult {
+    bool hashContent = false;            // 输入：是否计算写入内容的哈希
+    unsigned long long resumedFrom = 0;  // 本次续传的起始偏移（0 表示从头拷贝）
+    unsigned long long bytes = 0;        // 文件大小
+    uint64_t contentHash = 0;            // hashContent 为 true 时写入内容的 FNV-1a 哈希
+
+    // 输入：置位后在下一个数据块之前放弃拷贝，返回 false 且错误码为 ERROR_CANCELLED
+    const std::atomic<bool>* cancel = nullptr;
+    // 输入：非空时随拷贝进度累加已处理的字节数（续传时已有的部分一开始就计入）
+    std::atomic<unsigned long long>* progressBytes = nullptr;
+};
+
+// 拷贝单个文件。目标总是先写到临时文件再改名覆盖，中途崩溃不会留下写了一半的备份；
+// batch 非空时由它负责落盘。大文件写入 stagingDir 下的暂存文件，并周期性保存进度检查点
+// （已写入偏移 + 已写入内容的哈希），中断后再次调用会从检查点处继续。
+// 稀疏文件只拷贝已分配的区段并在目标上保留空洞，其余自行分块拷贝的文件预先分配目标空间。
+// 要求 hashContent 时小文件也自行分块拷贝，哈希在写入的同时计算。
+bool BackupCopyFile(const std::wstring& src, const std::wstring& dst, const std::wstring& stagingDir,
+                    DurabilityBatch* batch = nullptr, CopyResult* result = nullptr);
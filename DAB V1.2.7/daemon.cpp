@@ -0,0 +1,426 @@
+#include "daemon.h"
+#include "backup.h"
+#include "config.h"
+#include "jobs.h"
+#include "logger.h"
+#include <windows.h>
+#include <shlwapi.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <cstdio>
+
+namespace {
+
+const DWORD PIPE_BUFFER_SIZE = 64 * 1024;
+const size_t MAX_COMMAND_LENGTH = 256;
+const DWORD CLIENT_IO_TIMEOUT_MS = 5000;  // 客户端迟迟不发命令时放弃这个连接，不影响后面的客户端
+
+HANDLE g_stopEvent = NULL;  // Ctrl+C、关闭控制台或收到 quit 时置位
+HANDLE g_doneEvent = NULL;  // 守护进程清理完毕
+
+BOOL WINAPI ConsoleCtrlHandler(DWORD type) {
+    if (g_stopEvent) SetEvent(g_stopEvent);
+    // 关闭控制台、注销、关机时处理函数返回后进程就会被结束，先等主线程停止监听、写完日志
+    if (type == CTRL_CLOSE_EVENT || type == CTRL_LOGOFF_EVENT || type == CTRL_SHUTDOWN_EVENT) {
+        if (g_doneEvent) WaitForSingleObject(g_doneEvent, 5000);
+    }
+    return TRUE;
+}
+
+std::string ToUtf8(const std::wstring& s) {
+    if (s.empty()) return std::string();
+    int len = WideCharToMultiByte(CP_UTF8, 0, s.data(), (int)s.size(), NULL, 0, NULL, NULL);
+    std::string out(len > 0 ? len : 0, '\0');
+    if (len > 0) WideCharToMultiByte(CP_UTF8, 0, s.data(), (int)s.size(), &out[0], len, NULL, NULL);
+    return out;
+}
+
+std::wstring FromUtf8(const std::string& s) {
+    if (s.empty()) return std::wstring();
+    int len = MultiByteToWideChar(CP_UTF8, 0, s.data(), (int)s.size(), NULL, 0);
+    std::wstring out(len > 0 ? len : 0, L'\0');
+    if (len > 0) MultiByteToWideChar(CP_UTF8, 0, s.data(), (int)s.size(), &out[0], len);
+    return out;
+}
+
+// 程序是窗口子系统，从命令行启动时没有控制台；有重定向时直接用继承来的句柄，否则接到父进程的控制台上
+void AttachParentConsole() {
+    HANDLE out = GetStdHandle(STD_OUTPUT_HANDLE);
+    if (out != NULL && out != INVALID_HANDLE_VALUE) return;
+    if (!AttachConsole(ATTACH_PARENT_PROCESS)) return;
+
+    HANDLE con = CreateFileW(L"CONOUT$", GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                             NULL, OPEN_EXISTING, 0, NULL);
+    if (con != INVALID_HANDLE_VALUE) {
+        SetStdHandle(STD_OUTPUT_HANDLE, con);
+        SetStdHandle(STD_ERROR_HANDLE, con);
+    }
+}
+
+// 控制台上按宽字符输出（中文不乱码），重定向到文件或管道时输出 UTF-8
+void WriteOut(const std::string& utf8) {
+    HANDLE out = GetStdHandle(STD_OUTPUT_HANDLE);
+    if (out == NULL || out == INVALID_HANDLE_VALUE || utf8.empty()) return;
+
+    DWORD mode = 0, written = 0;
+    if (GetConsoleMode(out, &mode)) {
+        std::wstring text = FromUtf8(utf8);
+        WriteConsoleW(out, text.c_str(), (DWORD)text.size(), &written, NULL);
+    } else {
+        WriteFile(out, utf8.data(), (DWORD)utf8.size(), &written, NULL);
+    }
+}
+
+// 重叠方式读写管道，超时后取消；done 返回实际传输的字节数
+bool PipeIo(HANDLE pipe, HANDLE ev, bool write, void* buf, DWORD len, DWORD* done) {
+    OVERLAPPED ov = {};
+    ov.hEvent = ev;
+    ResetEvent(ev);
+    BOOL ok = write ? WriteFile(pipe, buf, len, NULL, &ov) : ReadFile(pipe, buf, len, NULL, &ov);
+    if (!ok && GetLastError() != ERROR_IO_PENDING) return false;
+
+    if (WaitForSingleObject(ev, CLIENT_IO_TIMEOUT_MS) != WAIT_OBJECT_0) {
+        CancelIo(pipe);
+        GetOverlappedResult(pipe, &ov, done, TRUE);
+        return false;
+    }
+    return GetOverlappedResult(pipe, &ov, done, FALSE) != 0;
+}
+
+DWORD WINAPI FlushPipeThread(LPVOID pipe) {
+    return FlushFileBuffers((HANDLE)pipe) ? 0 : GetLastError();
+}
+
+// 等客户端读走回复再断开（断开会丢弃它还没读走的数据），最多等 CLIENT_IO_TIMEOUT_MS。
+// FlushFileBuffers 没有超时，放到临时线程上执行，超时就取消它，客户端不读时不会卡住后面的命令
+void FlushReply(HANDLE pipe) {
+    HANDLE thread = CreateThread(NULL, 0, FlushPipeThread, pipe, 0, NULL);
+    if (!thread) return;
+    if (WaitForSingleObject(thread, CLIENT_IO_TIMEOUT_MS) != WAIT_OBJECT_0) {
+        CancelSynchronousIo(thread);
+        WaitForSingleObject(thread, INFINITE);
+    }
+    CloseHandle(thread);
+}
+
+class Daemon {
+public:
+    // jobsFile 非空时按作业文件运行多作业引擎，否则按 configFile 运行单个备份
+    Daemon(const std::wstring& configFile, const std::wstring& jobsFile)
+        : configPath(configFile), jobsPath(jobsFile), log(GetExeDirectory() + L"\\daemon.log") {
+        if (!jobsPath.empty()) engine = std::make_unique<JobEngine>();
+    }
+
+    ~Daemon() { shutdown(); }
+
+    bool loadConfig() {
+        if (engine) {
+            std::wstring error;
+            if (!engine->load(jobsPath, error)) {
+                note(L"[守护] " + error, LogLevel::Error);
+                return false;
+            }
+            return true;
+        }
+
+        std::wstring targetsMultiLine;
+        if (!LoadConfig(configPath, mgr, sourcePath, targetsMultiLine)) {
+            note(L"[守护] 无法读取配置文件: " + configPath, LogLevel::Error);
+            return false;
+        }
+        log.setRotation(mgr.logRotation);
+        targets = SplitLines(targetsMultiLine);
+        if (sourcePath.empty() || targets.empty()) {
+            note(L"[守护] 配置文件中没有源路径或目标路径: " + configPath, LogLevel::Error);
+            return false;
+        }
+
+        mgr.setWatchFile(sourcePath);
+        mgr.clearBackupTargets();
+        for (const auto& t : targets) {
+            mgr.addBackupTarget(t);
+        }
+        return true;
+    }
+
+    bool start() {
+        if (engine) {
+            if (engine->isRunning()) return true;
+            if (!engine->start()) {
+                note(L"[守护] 作业引擎启动失败", LogLevel::Error);
+                return false;
+            }
+            note(L"[守护] 作业引擎已启动（" + std::to_wstring(engine->jobCount()) + L" 个作业）: " + jobsPath);
+            return true;
+        }
+        if (mgr.isWatching()) return true;
+        if (!PathFileExistsW(sourcePath.c_str())) {
+            note(L"[守护] 源路径不存在，监听未启动: " + sourcePath, LogLevel::Error);
+            return false;
+        }
+        if (!mgr.startWatching()) {
+            note(L"[守护] 监听启动失败", LogLevel::Error);
+            return false;
+        }
+        note(std::wstring(L"[守护] 监听已开始（") + (mgr.pollingMode ? L"轮询" : L"事件") + L"）: " + sourcePath);
+        return true;
+    }
+
+    void stop() {
+        if (engine) {
+            engine->stop();
+            return;
+        }
+        if (!mgr.isWatching()) return;
+        mgr.stopWatching();
+        note(L"[守护] 监听已停止");
+    }
+
+    // 返回完整的回复（UTF-8），quit 命令时把 quit 置为 true
+    std::string handle(const std::wstring& line, bool& quit) {
+        // 命令后面可以跟一个参数，目前只有多作业模式的 backup-now <作业名> 使用
+        size_t space = line.find(L' ');
+        std::wstring command = line.substr(0, space);
+        std::wstring arg = space == std::wstring::npos ? std::wstring() : line.substr(space + 1);
+
+        if (command == L"start") {
+            return start() ? "OK\n" : "ERR start failed, see daemon.log\n";
+        }
+        if (command == L"stop") {
+            stop();
+            return "OK\n";
+        }
+        if (command == L"backup-now" && engine) {
+            if (!engine->isRunning()) return "ERR engine is not running\n";
+            if (!engine->trigger(arg)) return "ERR unknown job: " + ToUtf8(arg) + "\n";
+            note(L"[守护] 收到 backup-now，已排队: " + (arg.empty() ? std::wstring(L"全部作业") : arg));
+            return "OK\n";
+        }
+        if (command == L"backup-now") {
+            if (!mgr.startBackupAsync()) return "ERR a manual backup is already running\n";
+            note(L"[守护] 收到 backup-now，开始手动备份");
+            return "OK\n";
+        }
+        if (command == L"cancel" && !engine) {
+            if (!mgr.isBackupRunning()) return "ERR no manual backup is running\n";
+            mgr.cancelBackup();
+            note(L"[守护] 收到 cancel，正在取消手动备份");
+            return "OK\n";
+        }
+        if (command == L"status") {
+            return "OK\n" + status();
+        }
+        if (command == L"trace" && !engine) {
+            if (!mgr.traceEnabled) return "ERR tracing is disabled (TRACE=1 in the config file)\n";
+            if (!mgr.dumpTrace()) return "ERR failed to write the trace file\n";
+            return "OK\n";
+        }
+        if (command == L"metrics") {
+            return "OK\n" + (engine ? engine->metrics() : mgr.metrics.toPrometheus());
+        }
+        if (command == L"reload") {
+            // 不等手动备份做完（可能要很久），让客户端先 cancel；多作业引擎停止时自己会取消正在运行的作业
+            if (!engine && mgr.isBackupRunning()) return "ERR busy: a manual backup is running, cancel it first\n";
+            bool wasWatching = engine ? engine->isRunning() : mgr.isWatching();
+            stop();
+            if (!loadConfig()) return "ERR reload failed, see daemon.log\n";
+            note(L"[守护] 已重新读取配置: " + (engine ? jobsPath : configPath));
+            if (wasWatching && !start()) return "ERR restart failed, see daemon.log\n";
+            return "OK\n";
+        }
+        if (command == L"quit") {
+            quit = true;
+            return "OK\n";
+        }
+        return "ERR unknown command: " + ToUtf8(command) + "\n";
+    }
+
+    void shutdown() {
+        mgr.cancelBackup();
+        waitManual();
+        stop();
+        log.flush();
+    }
+
+    void note(const std::wstring& msg, LogLevel level = LogLevel::Info) {
+        log.write(msg, level);
+        WriteOut(ToUtf8(msg + L"\n"));
+    }
+
+private:
+    void waitManual() {
+        while (mgr.isBackupRunning()) Sleep(50);
+    }
+
+    std::string status() const {
+        if (engine) {
+            return "jobs_file=" + ToUtf8(jobsPath) + "\n" + engine->status();
+        }
+
+        const BackupMetrics& m = mgr.metrics;
+        const BackupProgress& p = mgr.progress();
+        char buf[768];
+        snprintf(buf, sizeof(buf),
+                 "watching=%d\npolling=%d\nincremental=%d\nmanual_backup=%d\n"
+                 "manual_files=%llu/%llu\nmanual_percent=%.1f\nmanual_eta_s=%.0f\n"
+                 "backups_triggered=%llu\nchanges_detected=%llu\nfiles_copied=%llu\nfiles_failed=%llu\n"
+                 "bytes_copied=%llu\nchange_to_commit_p50_ms=%.1f\nchange_to_commit_p99_ms=%.1f\n",
+                 mgr.isWatching() ? 1 : 0, mgr.pollingMode ? 1 : 0, mgr.incrementalMode ? 1 : 0,
+                 mgr.isBackupRunning() ? 1 : 0,
+                 (unsigned long long)p.filesDone.load(), (unsigned long long)p.filesTotal.load(),
+                 p.fraction() * 100, p.etaSeconds(),
+                 (unsigned long long)m.backupsTriggered.get(), (unsigned long long)m.changesDetected.get(),
+                 (unsigned long long)m.filesCopied.get(), (unsigned long long)m.filesFailed.get(),
+                 (unsigned long long)m.bytesCopied.get(),
+                 m.changeToCommit.valueAt(0.5) / 1000.0, m.changeToCommit.valueAt(0.99) / 1000.0);
+
+        std::string text = "config=" + ToUtf8(configPath) + "\nsource=" + ToUtf8(sourcePath) + "\n";
+        for (const auto& t : targets) {
+            text += "target=" + ToUtf8(t) + "\n";
+        }
+        return text + buf;
+    }
+
+    std::wstring configPath;
+    std::wstring jobsPath;
+    std::wstring sourcePath;
+    std::vector<std::wstring> targets;
+
+    AsyncLogger log;
+    BackupManager mgr;
+    std::unique_ptr<JobEngine> engine;
+
+};
+
+// 读一行命令（以 \n 结束），回复后等客户端读完再断开
+void ServeClient(HANDLE pipe, HANDLE ioEvent, Daemon& daemon, bool& quit) {
+    std::string line;
+    char buf[128];
+    while (line.find('\n') == std::string::npos && line.size() < MAX_COMMAND_LENGTH) {
+        DWORD got = 0;
+        if (!PipeIo(pipe, ioEvent, false, buf, sizeof(buf), &got) || got == 0) break;
+        line.append(buf, got);
+    }
+
+    size_t end = line.find_first_of("\r\n");
+    if (end == std::string::npos) {
+        if (line.empty() || line.size() >= MAX_COMMAND_LENGTH) return;  // 客户端断开或命令过长
+        end = line.size();
+    }
+    std::wstring command = FromUtf8(line.substr(0, end));
+
+    std::string reply = daemon.handle(command, quit);
+    DWORD sent = 0;
+    if (PipeIo(pipe, ioEvent, true, &reply[0], (DWORD)reply.size(), &sent)) {
+        FlushReply(pipe);
+    }
+}
+
+} // namespace
+
+int RunDaemon(const std::wstring& configPath, const std::wstring& jobsPath, const std::wstring& pipeName) {
+    AttachParentConsole();
+
+    g_stopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    g_doneEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    SetConsoleCtrlHandler(ConsoleCtrlHandler, TRUE);
+
+    int exitCode = 0;
+    {
+        Daemon daemon(configPath, jobsPath);
+        if (!daemon.loadConfig()) {
+            exitCode = 1;
+        } else {
+            // 只创建一个管道实例并反复使用；FIRST_PIPE_INSTANCE 保证同名的守护进程只有一个
+            HANDLE pipe = CreateNamedPipeW(pipeName.c_str(),
+                                           PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE,
+                                           PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+                                           1, PIPE_BUFFER_SIZE, PIPE_BUFFER_SIZE, 0, NULL);
+            if (pipe == INVALID_HANDLE_VALUE) {
+                daemon.note(L"[守护] 无法创建控制管道（可能已有守护进程在运行）: " + pipeName, LogLevel::Error);
+                exitCode = 1;
+            } else {
+                daemon.note(L"[守护] 控制管道: " + pipeName);
+                daemon.start();
+
+                HANDLE connectEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+                HANDLE ioEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+                bool quit = false;
+                while (!quit) {
+                    OVERLAPPED ov = {};
+                    ov.hEvent = connectEvent;
+                    ResetEvent(connectEvent);
+
+                    bool connected = ConnectNamedPipe(pipe, &ov) != 0;
+                    DWORD err = connected ? ERROR_SUCCESS : GetLastError();
+                    if (err == ERROR_IO_PENDING) {
+                        HANDLE waits[2] = { connectEvent, g_stopEvent };
+                        DWORD r = WaitForMultipleObjects(2, waits, FALSE, INFINITE);
+                        if (r != WAIT_OBJECT_0) {
+                            CancelIo(pipe);
+                            DWORD ignored = 0;
+                            GetOverlappedResult(pipe, &ov, &ignored, TRUE);
+                            break;
+                        }
+                        DWORD ignored = 0;
+                        connected = GetOverlappedResult(pipe, &ov, &ignored, FALSE) != 0;
+                    } else if (err == ERROR_PIPE_CONNECTED) {
+                        connected = true;  // 客户端在 ConnectNamedPipe 之前就连上了
+                    }
+
+                    if (connected) {
+                        ServeClient(pipe, ioEvent, daemon, quit);
+                    }
+                    DisconnectNamedPipe(pipe);
+                    if (WaitForSingleObject(g_stopEvent, 0) == WAIT_OBJECT_0) break;
+                }
+
+                CloseHandle(ioEvent);
+                CloseHandle(connectEvent);
+                CloseHandle(pipe);
+                daemon.note(L"[守护] 正在退出");
+            }
+        }
+        daemon.shutdown();
+    }
+
+    SetEvent(g_doneEvent);
+    return exitCode;
+}
+
+int RunControlClient(const std::wstring& pipeName, const std::wstring& command) {
+    AttachParentConsole();
+
+    HANDLE pipe = INVALID_HANDLE_VALUE;
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        pipe = CreateFileW(pipeName.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+        if (pipe != INVALID_HANDLE_VALUE || GetLastError() != ERROR_PIPE_BUSY) break;
+        WaitNamedPipeW(pipeName.c_str(), 5000);  // 守护进程正在服务另一个客户端
+    }
+    if (pipe == INVALID_HANDLE_VALUE) {
+        WriteOut(ToUtf8(L"无法连接守护进程: " + pipeName + L"\n"));
+        return 1;
+    }
+
+    std::string request = ToUtf8(command) + "\n";
+    DWORD written = 0;
+    if (!WriteFile(pipe, request.data(), (DWORD)request.size(), &written, NULL)) {
+        CloseHandle(pipe);
+        WriteOut(ToUtf8(L"发送命令失败\n"));
+        return 1;
+    }
+
+    std::string reply;
+    char buf[4096];
+    DWORD got = 0;
+    while (ReadFile(pipe, buf, sizeof(buf), &got, NULL) && got > 0) {
+        reply.append(buf, got);
+    }
+    CloseHandle(pipe);
+
+    WriteOut(reply);
+    return reply.compare(0, 2, "OK") == 0 ? 0 : 2;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+
+// 无界面运行（backup.exe --daemon）：按配置文件驱动 BackupManager，不创建窗口和消息循环，
+// 通过本机命名管道接受控制命令，脚本可以用 backup.exe --ctl <命令> 触发和查看备份。
+//
+// 协议：客户端连接后写入一行命令（UTF-8），服务端回复后关闭连接。
+// 回复第一行为 "OK" 或 "ERR 原因"，之后是正文。命令：
+//   start        按当前配置开始监听
+//   stop         停止监听
+//   backup-now   在后台立即执行一次备份（已有手动备份在进行时返回 ERR）；
+//                多作业模式下为 backup-now [作业名]，不写作业名时全部作业排队备份
+//   cancel       取消正在进行的手动备份（单作业模式）
+//   status       运行状态，每行一个 key=value
+//   metrics      Prometheus 文本格式的运行指标
+//   trace        把耗时跟踪写到 backup.trace（配置中 TRACE=1 时，单作业模式）
+//   reload       重新读取配置文件，正在监听时按新配置重新开始
+//   quit         停止监听并退出守护进程
+
+// 默认管道名，同一台机器上同时运行多个守护进程时用 --pipe 区分
+const wchar_t DAEMON_PIPE_NAME[] = L"\\\\.\\pipe\\DAB.control";
+
+// 一直运行到收到 quit 或 Ctrl+C / 关闭控制台，返回进程退出码。
+// jobsPath 非空时忽略 configPath，按作业文件（见 jobs.h）同时运行多个作业
+int RunDaemon(const std::wstring& configPath, const std::wstring& jobsPath, const std::wstring& pipeName);
+
+// 发送一条命令并把回复写到标准输出；连接失败返回 1，服务端回复 ERR 返回 2
+int RunControlClient(const std::wstring& pipeName, const std::wstring& command);
@@ -1,5 +1,7 @@
 #include "gui.h"
 #include "backup.h"
+#include "logview.h"
+#include "config.h"
 #include <commctrl.h>
 #include <shellapi.h>
 #include <string>
@@ -19,10 +21,24 @@
 #define ID_LOG_BOX       106
 #define ID_TRAY_EXIT     201
 #define ID_TRAY_SHOW     202
+#define ID_TRAY_METRICS  203
 #define ID_CHK_AUTORUN   107
 #define ID_CHK_POLLING   108  // 新增：轮询监听复选框控件ID
 #define ID_CHK_INCREMENT 110  // 1.2.7 新增：增量备份
+#define ID_STC_PROGRESS  111  // 手动备份进度
 #define ID_EDIT_MAX_BACKUP_COUNT 1239 //1.2.6 新增：最大保留数
+#define ID_TIMER_LOGVIEW 301
+#define ID_TIMER_PROGRESS 302
+#define WM_LOGVIEW_PENDING (WM_USER + 2)  // 日志窗口有了待刷新的行
+
+// 日志窗口最多保留的行数，以及有新日志后合并刷新的延迟（约 30 帧/秒）
+const size_t LOG_VIEW_CAPACITY = 5000;
+const UINT LOG_VIEW_REFRESH_MS = 33;
+// 窗口隐藏（最小化到托盘）时只把日志并入模型，间隔放长
+const UINT LOG_VIEW_HIDDEN_COMMIT_MS = 1000;
+
+// 手动备份进行时进度文字的刷新间隔
+const UINT BACKUP_PROGRESS_REFRESH_MS = 250;
 
 
 const wchar_t CLASS_NAME[] = L"BackupApp";
@@ -32,6 +48,7 @@ HWND hMainWnd, hLogBox;
 NOTIFYICONDATAW nid = {};
 
 BackupManager backupMgr;
+LogViewModel logView(LOG_VIEW_CAPACITY);
 
 std::wstring GetCurrentTimeStr() {
     std::time_t t = std::time(nullptr);
@@ -42,13 +59,6 @@ std::wstring GetCurrentTimeStr() {
     return buf;
 }
 
-std::wstring GetExeDirectory() {
-    wchar_t buffer[MAX_PATH];
-    GetModuleFileNameW(NULL, buffer, MAX_PATH);
-    PathRemoveFileSpecW(buffer);
-    return buffer;
-}
-
 void AddTrayIcon(HWND hWnd) {
     nid.cbSize = sizeof(nid);
     nid.hWnd = hWnd;
@@ -70,6 +80,7 @@ void ShowContextMenu(HWND hWnd) {
     GetCursorPos(&pt);
     HMENU hMenu = CreatePopupMenu();
     AppendMenuW(hMenu, MF_STRING, ID_TRAY_SHOW, L"显示窗口");
+    AppendMenuW(hMenu, MF_STRING, ID_TRAY_METRICS, L"运行指标");
     AppendMenuW(hMenu, MF_STRING, ID_TRAY_EXIT, L"退出");
 
     SetForegroundWindow(hWnd);
@@ -77,240 +88,32 @@ void ShowContextMenu(HWND hWnd) {
     DestroyMenu(hMenu);
 }
 
-void Log(const std::wstring& msg) {
-    // 时间戳
-    std::time_t t = std::time(nullptr);
-    std::tm local{};
-    localtime_s(&local, &t);
-    wchar_t timebuf[64];
-    wcsftime(timebuf, 64, L"[%Y-%m-%d %H:%M:%S] ", &local);
-    std::wstring fullMsg = timebuf + msg + L"\r\n";
-
-    if (hLogBox && IsWindow(hLogBox)) {
-        SendMessageW(hLogBox, WM_SETREDRAW, FALSE, 0);
-
-        int textLength = (int)SendMessageW(hLogBox, WM_GETTEXTLENGTH, 0, 0);
-        SendMessageW(hLogBox, EM_SETSEL, textLength, textLength);
-        SendMessageW(hLogBox, EM_REPLACESEL, FALSE, (LPARAM)fullMsg.c_str());
-
-        // 先把插入点移到末尾
-        int newLength = (int)SendMessageW(hLogBox, WM_GETTEXTLENGTH, 0, 0);
-        SendMessageW(hLogBox, EM_SETSEL, newLength, newLength);
-
-        // 先滚动光标
-        SendMessageW(hLogBox, EM_SCROLLCARET, 0, 0);
-        // 再强制往下滚动1行
-        SendMessageW(hLogBox, EM_LINESCROLL, 0, 5);
+// gui.log 与 backup.log 一样由异步日志写入和轮转，路径只在第一次使用时计算
+AsyncLogger& GuiLogFile() {
+    static AsyncLogger logger(GetExeDirectory() + L"\\gui.log");
+    return logger;
+}
 
-        SendMessageW(hLogBox, WM_SETREDRAW, TRUE, 0);
-        InvalidateRect(hLogBox, NULL, TRUE);
-        UpdateWindow(hLogBox);
+void Log(const std::wstring& msg) {
+    // 只放进日志窗口的模型，由定时器成批刷新到界面
+    if (logView.post(GetCurrentTimeStr() + msg) && hMainWnd) {
+        PostMessageW(hMainWnd, WM_LOGVIEW_PENDING, 0, 0);
     }
 
 
-    //写入日志文件（支持中文路径）
-    std::wstring path = GetExeDirectory() + L"\\gui.log";
-
-    HANDLE hFile = CreateFileW(
-        path.c_str(),
-        FILE_APPEND_DATA,
-        FILE_SHARE_READ,
-        NULL,
-        OPEN_ALWAYS,
-        FILE_ATTRIBUTE_NORMAL,
-        NULL
-    );
-
-    if (hFile != INVALID_HANDLE_VALUE) {
-        DWORD written = 0;
-        // 转为 UTF-8 编码输出
-        int len = WideCharToMultiByte(CP_UTF8, 0, fullMsg.c_str(), -1, NULL, 0, NULL, NULL);
-        if (len > 1) {
-            std::string utf8(len - 1, '\0');  // 不包括 null 结尾
-            WideCharToMultiByte(CP_UTF8, 0, fullMsg.c_str(), -1, &utf8[0], len, NULL, NULL);
-            WriteFile(hFile, utf8.c_str(), (DWORD)utf8.size(), &written, NULL);
-        }
-        CloseHandle(hFile);
-    } else {
-        // 回显错误
-        if (hLogBox && IsWindow(hLogBox)) {
-            SendMessageW(hLogBox, EM_REPLACESEL, 0, (LPARAM)L"写日志失败：路径无效或被占用\r\n");
-        }
-    }
+    //写入日志文件（支持中文路径），由日志线程负责 UTF-8 转换和写盘
+    GuiLogFile().write(msg);
 }
 
-
-void SaveConfig(const std::wstring& sourcePath, const std::wstring& targetsMultiLine) {
-    std::wstring pollingLine = backupMgr.pollingMode ? L"POLLING=1" : L"POLLING=0";
-    std::wstring increLine = backupMgr.incrementalMode ? L"INCREMENTAL=1" : L"INCREMENTAL=0";
-    std::wstring pollingIntervalLine = L"POLLING_INTERVAL=" + std::to_wstring(backupMgr.pollingInterval);
-    std::wstring maxBackupCount = L"MAX_BACKUP_COUNT=" + std::to_wstring(backupMgr.maxBackupCount); //1.3.0 最大备份数
-
-    std::wstring content = sourcePath + L"\n" 
-                        + targetsMultiLine + L"\n" 
-                        + pollingLine + L"\n" 
-                        + increLine + L"\n"
-                        + pollingIntervalLine + L"\n"
-                        + maxBackupCount + L"\n";
-
-    std::wstring path = GetExeDirectory() + L"\\config.ini";
-
-    HANDLE hFile = CreateFileW(
-        path.c_str(),
-        GENERIC_WRITE,
-        0,
-        NULL,
-        CREATE_ALWAYS,
-        FILE_ATTRIBUTE_NORMAL,
-        NULL
-    );
-
-    if (hFile != INVALID_HANDLE_VALUE) {
-        DWORD written = 0;
-        int len = WideCharToMultiByte(CP_UTF8, 0, content.c_str(), -1, NULL, 0, NULL, NULL);
-        if (len > 1) {
-            std::string utf8(len - 1, '\0');
-            WideCharToMultiByte(CP_UTF8, 0, content.c_str(), -1, &utf8[0], len, NULL, NULL);
-            WriteFile(hFile, utf8.c_str(), (DWORD)utf8.size(), &written, NULL);
-        }
-        CloseHandle(hFile);
+void SaveSettings(const std::wstring& sourcePath, const std::wstring& targetsMultiLine) {
+    std::wstring path = DefaultConfigPath();
+    if (SaveConfig(path, backupMgr, sourcePath, targetsMultiLine)) {
         Log(L"配置保存成功: " + path);
     } else {
         Log(L"无法保存配置: " + path);
     }
 }
 
-void TrimTrailingNewlines(std::wstring& str) {
-    while (!str.empty() && (str.back() == L'\n' || str.back() == L'\r')) {
-        str.pop_back();
-    }
-}
-
-void LoadConfig(std::wstring& sourcePath, std::wstring& targetsMultiLine) {
-    std::wstring path = GetExeDirectory() + L"\\config.ini";
-    HANDLE hFile = CreateFileW(
-        path.c_str(),
-        GENERIC_READ,
-        FILE_SHARE_READ,
-        NULL,
-        OPEN_EXISTING,
-        FILE_ATTRIBUTE_NORMAL,
-        NULL
-    );
-
-    if (hFile == INVALID_HANDLE_VALUE) {
-        sourcePath.clear();
-        targetsMultiLine.clear();
-        return;
-    }
-
-    DWORD fileSize = GetFileSize(hFile, NULL);
-    if (fileSize == INVALID_FILE_SIZE || fileSize == 0) {
-        CloseHandle(hFile);
-        return;
-    }
-
-    std::string utf8Data(fileSize, '\0');
-    DWORD bytesRead;
-    ReadFile(hFile, &utf8Data[0], fileSize, &bytesRead, NULL);
-    CloseHandle(hFile);
-
-    int wideLen = MultiByteToWideChar(CP_UTF8, 0, utf8Data.c_str(), -1, NULL, 0);
-    if (wideLen <= 0) return;
-    std::wstring wContent(wideLen, L'\0');
-    MultiByteToWideChar(CP_UTF8, 0, utf8Data.c_str(), -1, &wContent[0], wideLen);
-
-    if (!wContent.empty() && wContent.back() == L'\0') {
-        wContent.pop_back();
-    }
-
-    // 拆分为多行
-    std::vector<std::wstring> lines;
-    size_t start = 0, end = 0;
-    while ((end = wContent.find(L'\n', start)) != std::wstring::npos) {
-        std::wstring line = wContent.substr(start, end - start);
-        TrimTrailingNewlines(line);
-        lines.push_back(line);
-        start = end + 1;
-    }
-    if (start < wContent.size()) {
-        std::wstring line = wContent.substr(start);
-        TrimTrailingNewlines(line);
-        lines.push_back(line);
-    }
-
-    // 解析 sourcePath
-    if (!lines.empty()) sourcePath = lines[0];
-
-    // 解析目标路径们（从第2行开始，一直到遇到关键词行为止）
-    targetsMultiLine.clear();
-    size_t i = 1;
-    for (; i < lines.size(); ++i) {
-        if (lines[i].find(L"POLLING=") == 0 ||
-            lines[i].find(L"INCREMENTAL=") == 0 ||
-            lines[i].find(L"POLLING_INTERVAL=") == 0 ||
-            lines[i].find(L"MAX_BACKUP_COUNT=") == 0) {
-            break;
-        }
-        targetsMultiLine += lines[i] + L"\r\n";
-    }
-
-    // 后续行为设置项
-    for (; i < lines.size(); ++i) {
-        const std::wstring& line = lines[i];
-        if (line.find(L"POLLING=") == 0) {
-            backupMgr.pollingMode = (line == L"POLLING=1");
-        } else if (line.find(L"INCREMENTAL=")==0) {
-            backupMgr.incrementalMode = (line == L"INCREMENTAL=1");
-        } else if (line.find(L"POLLING_INTERVAL=") == 0) {
-            try {
-                int val = std::stoi(line.substr(17)); // 17 = strlen("POLLING_INTERVAL=")
-                backupMgr.setPollingInterval(val);
-            } catch (...) {
-                backupMgr.setPollingInterval(3000); // 默认值
-            }
-        } else if (line.find(L"MAX_BACKUP_COUNT=") == 0) {
-            try {
-                int val = std::stoi(line.substr(17)); // 17 = strlen("MAX_BACKUP_COUNT=")
-                backupMgr.setMaxBackupCount(val);
-            } catch (...) {
-                backupMgr.setMaxBackupCount(10); // 默认值
-            }
-        }
-    }
-
-    TrimTrailingNewlines(sourcePath);
-    TrimTrailingNewlines(targetsMultiLine);
-}
-
-std::vector<std::wstring> SplitLines(const std::wstring& str) {
-    std::vector<std::wstring> result;
-    size_t start = 0;
-    while (true) {
-        size_t pos = str.find(L'\n', start);
-        std::wstring line;
-        if (pos == std::wstring::npos) {
-            line = str.substr(start);
-        } else {
-            line = str.substr(start, pos - start);
-        }
-
-        if (!line.empty() && line.back() == L'\r') {
-            line.pop_back();
-        }
-
-        if (!line.empty()) {
-            result.push_back(line);
-        }
-
-        if (pos == std::wstring::npos) {
-            break;
-        }
-        start = pos + 1;
-    }
-    return result;
-}
-
 
 bool CheckSingleInstance(HINSTANCE hInstance) {
     // 创建命名互斥体
@@ -376,23 +179,63 @@ bool IsAutoRunEnabled() {
     return (ret == ERROR_SUCCESS);
 }
 
-//1.1.4 日志窗口子类化 接收滚轮消息
+// 把上一帧以来的日志并入虚拟列表：只更新行数并重绘新增的行，用户停在最底部时才自动滚动
+void RefreshLogView() {
+    size_t evicted = 0;
+    if (logView.commit(&evicted) == 0 || !hLogBox) return;
 
-WNDPROC g_OldLogProc = NULL;
+    int oldCount = (int)SendMessageW(hLogBox, LVM_GETITEMCOUNT, 0, 0);
+    int top = (int)SendMessageW(hLogBox, LVM_GETTOPINDEX, 0, 0);
+    int perPage = (int)SendMessageW(hLogBox, LVM_GETCOUNTPERPAGE, 0, 0);
+    bool follow = top + perPage >= oldCount;
 
-LRESULT CALLBACK LogEditProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
-    switch (msg) {
-        case WM_VSCROLL:
-        case WM_MOUSEWHEEL:
-            {
-                LRESULT ret = CallWindowProcW(g_OldLogProc, hwnd, msg, wParam, lParam);
-                InvalidateRect(hwnd, NULL, TRUE);
-                UpdateWindow(hwnd);
-                return ret;
-            }
-        default:
-            return CallWindowProcW(g_OldLogProc, hwnd, msg, wParam, lParam);
+    int count = (int)logView.size();
+    SendMessageW(hLogBox, LVM_SETITEMCOUNT, count, LVSICF_NOSCROLL | LVSICF_NOINVALIDATEALL);
+    if (evicted > 0) {
+        InvalidateRect(hLogBox, NULL, FALSE);  // 挤掉了旧行，所有行号都变了
+    } else {
+        SendMessageW(hLogBox, LVM_REDRAWITEMS, oldCount, count - 1);
+    }
+    if (follow) {
+        SendMessageW(hLogBox, LVM_ENSUREVISIBLE, count - 1, FALSE);
+    }
+}
+
+// 窗口隐藏期间日志只并入模型，重新显示时整个列表按模型刷新一次
+void ResyncLogView() {
+    if (!hLogBox) return;
+    int count = (int)logView.size();
+    SendMessageW(hLogBox, LVM_SETITEMCOUNT, count, LVSICF_NOSCROLL);
+    InvalidateRect(hLogBox, NULL, FALSE);
+    if (count > 0) SendMessageW(hLogBox, LVM_ENSUREVISIBLE, count - 1, FALSE);
+}
+
+// 手动备份在后台线程运行，界面定时读取进度；备份结束后恢复按钮并停止定时器
+void RefreshBackupProgress(HWND hwnd) {
+    HWND hProgress = GetDlgItem(hwnd, ID_STC_PROGRESS);
+    if (!backupMgr.isBackupRunning()) {
+        KillTimer(hwnd, ID_TIMER_PROGRESS);
+        SetWindowTextW(GetDlgItem(hwnd, ID_BTN_BACKUP), L"立即备份");
+        bool cancelled = backupMgr.lastBackupCancelled();
+        SetWindowTextW(hProgress, cancelled ? L"手动备份已取消" : L"手动备份已完成");
+        Log(cancelled ? L"手动备份已取消" : L"手动备份已执行");
+        return;
+    }
+
+    const BackupProgress& p = backupMgr.progress();
+    wchar_t text[128];
+    double eta = p.etaSeconds();
+    if (p.filesTotal.load() == 0) {
+        swprintf(text, 128, L"正在统计源文件...");
+    } else if (eta < 0) {
+        swprintf(text, 128, L"备份中 %llu/%llu 个文件 %.0f%%",
+                 p.filesDone.load(), p.filesTotal.load(), p.fraction() * 100);
+    } else {
+        swprintf(text, 128, L"备份中 %llu/%llu 个文件 %.0f%%，剩余约 %d:%02d",
+                 p.filesDone.load(), p.filesTotal.load(), p.fraction() * 100,
+                 (int)eta / 60, (int)eta % 60);
     }
+    SetWindowTextW(hProgress, text);
 }
 
 LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
@@ -415,6 +258,49 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
             return (INT_PTR)GetSysColorBrush(COLOR_WINDOW);  // 返回主窗口背景色刷子
         }
 
+        case WM_TIMER:
+            if (wParam == ID_TIMER_LOGVIEW) {
+                // 一次性的：队列已取空，之后再有日志时由 WM_LOGVIEW_PENDING 重新安排
+                KillTimer(hwnd, ID_TIMER_LOGVIEW);
+                if (IsWindowVisible(hwnd)) RefreshLogView();
+                else logView.commit();  // 不重绘，只是让待处理队列不要一直增长
+                return 0;
+            }
+            if (wParam == ID_TIMER_PROGRESS) {
+                RefreshBackupProgress(hwnd);
+                return 0;
+            }
+            break;
+
+        case WM_LOGVIEW_PENDING:
+            SetTimer(hwnd, ID_TIMER_LOGVIEW, IsWindowVisible(hwnd) ? LOG_VIEW_REFRESH_MS : LOG_VIEW_HIDDEN_COMMIT_MS, NULL);
+            return 0;
+
+        case WM_SHOWWINDOW:
+            // 隐藏期间并入的行没有画到列表上，显示时整体刷新；隐藏前先取空队列，剩下的由长间隔定时器处理
+            KillTimer(hwnd, ID_TIMER_LOGVIEW);
+            if (wParam) {
+                logView.commit();
+                ResyncLogView();
+            } else {
+                RefreshLogView();
+            }
+            break;
+
+        case WM_NOTIFY: {
+            // 虚拟列表按行号向模型取文本
+            NMHDR* hdr = (NMHDR*)lParam;
+            if (hdr->idFrom == ID_LOG_BOX && hdr->code == LVN_GETDISPINFOW) {
+                NMLVDISPINFOW* info = (NMLVDISPINFOW*)lParam;
+                if ((info->item.mask & LVIF_TEXT) && info->item.iItem >= 0 &&
+                    info->item.iItem < (int)logView.size()) {
+                    lstrcpynW(info->item.pszText, logView.line(info->item.iItem).c_str(), info->item.cchTextMax);
+                }
+                return 0;
+            }
+            break;
+        }
+
         case WM_CREATE: {
             
             static HFONT hFont = CreateFontW(
@@ -433,6 +319,10 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
                 250, 370, 200, 20, hwnd, NULL, g_hInstance, NULL);
             ApplyUIFont(hCopyright);
 
+            HWND hProgress = CreateWindowW(L"static", L"", WS_CHILD | WS_VISIBLE,
+                10, 370, 240, 20, hwnd, (HMENU)ID_STC_PROGRESS, g_hInstance, NULL);
+            ApplyUIFont(hProgress);
+
             HWND hLabel1 = CreateWindowW(L"static", L"源文件路径:", WS_CHILD | WS_VISIBLE,
                 10, 10, 90, 20, hwnd, NULL, g_hInstance, NULL);
             ApplyUIFont(hLabel1);
@@ -491,18 +381,27 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
                 320, 210, 100, 25, hwnd, (HMENU)ID_EDIT_MAX_BACKUP_COUNT, g_hInstance, NULL);
             ApplyUIFont(hMaxBackupCount);
 
-            hLogBox = CreateWindowW(L"edit", L"", WS_CHILD | WS_VISIBLE | WS_BORDER | ES_MULTILINE | WS_VSCROLL | ES_AUTOVSCROLL,
+            // 日志窗口为虚拟列表（LVS_OWNERDATA）：控件本身不保存文本，行数再多也只绘制可见的几行
+            hLogBox = CreateWindowW(WC_LISTVIEWW, L"", WS_CHILD | WS_VISIBLE | WS_BORDER | LVS_REPORT | LVS_OWNERDATA |
+                LVS_NOCOLUMNHEADER | LVS_SINGLESEL,
                 10, 240, 440, 120, hwnd, (HMENU)ID_LOG_BOX, g_hInstance, NULL);
             ApplyUIFont(hLogBox);
-            SendMessageW(hLogBox, EM_SETREADONLY, TRUE, 0);
+            SendMessageW(hLogBox, LVM_SETEXTENDEDLISTVIEWSTYLE, 0, LVS_EX_DOUBLEBUFFER | LVS_EX_FULLROWSELECT);
 
-            g_OldLogProc = (WNDPROC)SetWindowLongPtrW(hLogBox, GWLP_WNDPROC, (LONG_PTR)LogEditProc);
+            LVCOLUMNW col = {};
+            col.mask = LVCF_WIDTH;
+            col.cx = 2000;  // 足够放下长路径，超出部分可以横向滚动查看
+            SendMessageW(hLogBox, LVM_INSERTCOLUMNW, 0, (LPARAM)&col);
+
+            // 窗口句柄要等创建完才有，这之前写的日志不会发 WM_LOGVIEW_PENDING，先安排一次刷新
+            SetTimer(hwnd, ID_TIMER_LOGVIEW, LOG_VIEW_REFRESH_MS, NULL);
 
             AddTrayIcon(hwnd);
 
             // 加载配置
             std::wstring src, targetsMultiLine;
-            LoadConfig(src, targetsMultiLine);
+            LoadConfig(DefaultConfigPath(), backupMgr, src, targetsMultiLine);
+            GuiLogFile().setRotation(backupMgr.logRotation);
             SetWindowTextW(hSourceEdit, src.c_str());
             SetWindowTextW(hTargetEdit, targetsMultiLine.c_str());
             SetWindowTextW(GetDlgItem(hwnd, 109), std::to_wstring(backupMgr.pollingInterval).c_str());
@@ -544,6 +443,10 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
         case WM_COMMAND: {
             switch (LOWORD(wParam)) {
                 case ID_BTN_START: {                    
+                    if (backupMgr.isBackupRunning()) {
+                        Log(L"手动备份进行中，请等待完成或取消后再开始监听");
+                        break;
+                    }
 
                     wchar_t sourcePath[512] = {0};
                     GetWindowTextW(GetDlgItem(hwnd, ID_EDT_SOURCE), sourcePath, 512);
@@ -615,7 +518,7 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
                         backupMgr.addBackupTarget(t);
                     }
 
-                    SaveConfig(sourcePath, targetsStr);
+                    SaveSettings(sourcePath, targetsStr);
 
                     if (backupMgr.startWatching()) {
                         Log(L"监听已开始...");
@@ -629,6 +532,13 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
                     Log(L"监听已停止。");
                     break;
                 case ID_BTN_BACKUP: {
+                    // 备份进行中按钮显示为"取消"
+                    if (backupMgr.isBackupRunning()) {
+                        backupMgr.cancelBackup();
+                        SetWindowTextW(GetDlgItem(hwnd, ID_STC_PROGRESS), L"正在取消...");
+                        break;
+                    }
+
                     wchar_t sourcePath[512] = { 0 };
                     GetWindowTextW(GetDlgItem(hwnd, ID_EDT_SOURCE), sourcePath, 512);
 
@@ -652,10 +562,7 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
                     auto targets = SplitLines(targetsStr);
 
                     backupMgr.setWatchFile(sourcePath);
-                    backupMgr.clearBackupTargets();
-                    for (const auto& t : targets) {
-                        backupMgr.addBackupTarget(t);
-                    }
+                    backupMgr.setBackupTargets(targets);
 
                     wchar_t MBCbuffer[16];
                     GetWindowTextW(GetDlgItem(hwnd, ID_EDIT_MAX_BACKUP_COUNT), MBCbuffer, 16);
@@ -663,9 +570,13 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
                     if (maxCount <= 0) maxCount = 10; // 设置默认值
                     backupMgr.setMaxBackupCount(maxCount);
 
-                    backupMgr.backupFile();
-                    Log(L"手动备份已执行");
-                    SaveConfig(sourcePath, targetsStr);
+                    if (backupMgr.startBackupAsync()) {
+                        Log(L"手动备份已开始");
+                        SetWindowTextW(GetDlgItem(hwnd, ID_BTN_BACKUP), L"取消");
+                        SetTimer(hwnd, ID_TIMER_PROGRESS, BACKUP_PROGRESS_REFRESH_MS, NULL);
+                        RefreshBackupProgress(hwnd);
+                    }
+                    SaveSettings(sourcePath, targetsStr);
                     break;
                 }
                 case ID_CHK_AUTORUN: {
@@ -686,6 +597,15 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
                 case ID_TRAY_SHOW:
                     ShowWindow(hwnd, SW_SHOW);
                     break;
+                case ID_TRAY_METRICS: {
+                    // 同时导出一份到程序目录，方便对照或手动上传
+                    std::wstring path = backupMgr.metricsFile.empty()
+                        ? GetExeDirectory() + L"\\" + METRICS_FILE_NAME : backupMgr.metricsFile;
+                    std::wstring text = backupMgr.metrics.summary();
+                    text += backupMgr.metrics.writeFile(path) ? L"\r\n已导出: " + path : L"\r\n导出失败: " + path;
+                    MessageBoxW(hwnd, text.c_str(), L"运行指标", MB_ICONINFORMATION);
+                    break;
+                }
             }
             break;
         }
@@ -698,6 +618,10 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
             ShowWindow(hwnd, SW_HIDE);
             return 0;
         case WM_DESTROY:
+            KillTimer(hwnd, ID_TIMER_LOGVIEW);
+            KillTimer(hwnd, ID_TIMER_PROGRESS);
+            backupMgr.cancelBackup();
+            backupMgr.dumpTrace();
             RemoveTrayIcon();
             PostQuitMessage(0);
             break;
@@ -710,6 +634,9 @@ int RunBackupApp(HINSTANCE hInstance, int nCmdShow) {
 
     g_hInstance = hInstance;
 
+    INITCOMMONCONTROLSEX icc = { sizeof(icc), ICC_LISTVIEW_CLASSES };
+    InitCommonControlsEx(&icc);
+
     WNDCLASSW wc = {};
     wc.lpfnWndProc = WndProc;
     wc.hInstance = hInstance;
@@ -0,0 +1,583 @@
+#include "jobs.h"
+#include "config.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cwctype>
+
+namespace {
+
+// 完成端口的键：作业的目录句柄使用 JOB_KEY_BASE + 作业下标
+const ULONG_PTR KEY_STOP = 1;
+const ULONG_PTR KEY_REARM_TIMER = 2;  // 轮询作业跑完后重新计时，作业下标放在传输字节数里
+const ULONG_PTR JOB_KEY_BASE = 16;
+
+const DWORD NOTIFY_BUFFER_SIZE = 16 * 1024;
+const DWORD NOTIFY_FILTER = FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_CREATION |
+                            FILE_NOTIFY_CHANGE_FILE_NAME;
+
+std::wstring ToLower(std::wstring s) {
+    std::transform(s.begin(), s.end(), s.begin(), [](wchar_t c) { return std::towlower(c); });
+    return s;
+}
+
+std::string ToUtf8(const std::wstring& s) {
+    if (s.empty()) return std::string();
+    int len = WideCharToMultiByte(CP_UTF8, 0, s.data(), (int)s.size(), NULL, 0, NULL, NULL);
+    std::string out(len > 0 ? len : 0, '\0');
+    if (len > 0) WideCharToMultiByte(CP_UTF8, 0, s.data(), (int)s.size(), &out[0], len, NULL, NULL);
+    return out;
+}
+
+} // namespace
+
+bool LoadJobs(const std::wstring& path, JobsFile& out, std::wstring& error) {
+    std::vector<std::wstring> lines;
+    if (!ReadTextLines(path, lines)) {
+        error = L"无法读取作业文件: " + path;
+        return false;
+    }
+
+    out = JobsFile();
+    JobConfig* job = nullptr;
+    for (size_t n = 0; n < lines.size(); ++n) {
+        const std::wstring& line = lines[n];
+        if (line.empty() || line[0] == L';' || line[0] == L'#') continue;
+
+        if (line[0] == L'[') {
+            size_t close = line.find(L']');
+            if (close == std::wstring::npos || close == 1) {
+                error = L"第 " + std::to_wstring(n + 1) + L" 行：作业名无效";
+                return false;
+            }
+            out.jobs.emplace_back();
+            job = &out.jobs.back();
+            job->name = line.substr(1, close - 1);
+            continue;
+        }
+
+        size_t eq = line.find(L'=');
+        if (eq == std::wstring::npos) {
+            error = L"第 " + std::to_wstring(n + 1) + L" 行：缺少 '='";
+            return false;
+        }
+        std::wstring key = line.substr(0, eq);
+        std::wstring value = line.substr(eq + 1);
+        int number = _wtoi(value.c_str());
+
+        if (!job) {
+            if (key == L"WORKERS") out.workers = std::max(0, number);
+            else if (key == L"LOG_LEVEL") out.logLevel = ParseLogLevel(value);
+            else if (key == L"LOAD_GATE") out.load.enabled = (value != L"0");
+            else if (key == L"LOAD_CPU") out.load.cpuPercent = std::max(0, number);
+            else if (key == L"LOAD_DISK_QUEUE") out.load.diskQueue = std::max(0, number);
+            else if (key == L"LOAD_ON_BATTERY") out.load.deferOnBattery = (value != L"0");
+            else if (key == L"LOAD_MAX_DEFER") out.load.maxDeferSeconds = std::max(0, number);
+            continue;
+        }
+
+        if (key == L"SOURCE") job->source = value;
+        else if (key == L"TARGET") job->targets.push_back(value);
+        else if (key == L"POLLING") job->polling = (value == L"1");
+        else if (key == L"INCREMENTAL") job->incremental = (value == L"1");
+        else if (key == L"POLLING_INTERVAL") job->pollingInterval = std::max(100, number);
+        else if (key == L"MAX_BACKUP_COUNT") job->maxBackupCount = number > 0 ? number : 10;
+        else if (key == L"QUOTA_MB") job->quotaMB = std::max(0, number);
+        else if (key == L"LOW_PRIORITY") job->lowPriority = (value != L"0");
+        else if (key == L"PRIORITY") job->priority = std::min(JOB_PRIORITY_HIGHEST, std::max(JOB_PRIORITY_LOWEST, number));
+    }
+
+    for (const auto& j : out.jobs) {
+        if (j.source.empty() || j.targets.empty()) {
+            error = L"作业 [" + j.name + L"] 缺少 SOURCE 或 TARGET";
+            return false;
+        }
+    }
+    return true;
+}
+
+struct JobEngine::Job {
+    JobConfig config;
+    std::unique_ptr<BackupManager> mgr;
+    double weight = 1;
+    size_t device = 0;  // 源所在卷在 deviceScans 中的下标
+
+    // 事件模式：源是文件夹时递归监听它本身，源是文件时监听所在目录并按文件名过滤
+    bool sourceIsDirectory = false;
+    std::wstring watchDir;
+    std::wstring fileNameLower;
+    HANDLE hDir = INVALID_HANDLE_VALUE;
+    OVERLAPPED ov = {};
+    std::vector<DWORD> buffer;  // FILE_NOTIFY_INFORMATION 要求 DWORD 对齐
+    bool ioPending = false;     // 只由监听线程访问
+
+    // 以下由引擎的 mtx 保护
+    bool queued = false;
+    bool runningNow = false;
+    bool rerun = false;          // 运行中又有变化，结束后再跑一次
+    bool scanOnly = false;       // 这次只是轮询到期，先扫描，有变化才备份
+    bool urgent = false;         // 有手动触发，不因负载推迟
+    bool polling = false;        // 按轮询运行：配置为轮询，或目录监听失败后改为轮询
+    uint64_t deferredSince = 0;  // 因负载推迟的开始时间（MetricsNowMicros），0 表示没有推迟
+    uint64_t detectedAt = 0;     // 尚未处理的最早一次变化的时间，0 表示手动触发
+    double vtime = 0;
+    uint64_t lastRunMicros = 0;
+    uint64_t runs = 0;
+};
+
+JobEngine::JobEngine()
+    : logger(std::make_shared<AsyncLogger>(L"backup.log")) {
+    pruner = std::make_shared<PruneWorker>([this](const std::wstring& msg) { logger->write(msg); });
+}
+
+JobEngine::~JobEngine() {
+    stop();
+}
+
+void JobEngine::note(const std::wstring& msg, LogLevel level) {
+    logger->write(L"[作业] " + msg, level);
+}
+
+bool JobEngine::load(const std::wstring& path, std::wstring& error) {
+    if (running.load()) {
+        error = L"作业运行中，不能重新加载";
+        return false;
+    }
+
+    JobsFile file;
+    if (!LoadJobs(path, file, error)) return false;
+
+    unsigned hw = std::thread::hardware_concurrency();
+    workerCount = file.workers > 0 ? file.workers : (int)std::min(4u, std::max(1u, hw));
+    logger->setLevel(file.logLevel);
+    loadGate.setLimits(file.load);
+
+    jobs.clear();
+    std::vector<std::wstring> devices;
+    for (const auto& config : file.jobs) {
+        auto job = std::make_unique<Job>();
+        job->config = config;
+        job->weight = (double)(1 << config.priority);
+
+        job->mgr = std::make_unique<BackupManager>(logger, pruner, config.name);
+        BackupManager& mgr = *job->mgr;
+        mgr.setWatchFile(config.source);
+        for (const auto& t : config.targets) mgr.addBackupTarget(t);
+        mgr.setPollingMode(config.polling);
+        mgr.setPollingInterval(config.pollingInterval);
+        mgr.setIncrementalMode(config.incremental);
+        mgr.setMaxBackupCount(config.maxBackupCount);
+        mgr.setQuotaMB(config.quotaMB);
+        mgr.setLowPriority(config.lowPriority);
+
+        DWORD attr = GetFileAttributesW(config.source.c_str());
+        job->sourceIsDirectory = attr != INVALID_FILE_ATTRIBUTES && (attr & FILE_ATTRIBUTE_DIRECTORY);
+        std::filesystem::path src(config.source);
+        job->watchDir = job->sourceIsDirectory ? config.source : src.parent_path().wstring();
+        job->fileNameLower = ToLower(src.filename().wstring());
+
+        // 同一个卷上的作业共用一个下标，轮询扫描时错开
+        wchar_t volume[MAX_PATH] = {};
+        std::wstring device = GetVolumePathNameW(config.source.c_str(), volume, MAX_PATH)
+                                  ? ToLower(volume) : ToLower(src.root_path().wstring());
+        auto found = std::find(devices.begin(), devices.end(), device);
+        job->device = found - devices.begin();
+        if (found == devices.end()) devices.push_back(device);
+        jobs.push_back(std::move(job));
+    }
+    deviceScans.assign(devices.size(), 0);
+    note(L"已加载 " + std::to_wstring(jobs.size()) + L" 个作业，工作线程 " + std::to_wstring(workerCount) + L" 个: " + path);
+    return true;
+}
+
+bool JobEngine::start() {
+    if (running.load() || jobs.empty()) return false;
+
+    iocp = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+    if (!iocp) {
+        note(L"创建完成端口失败", LogLevel::Error);
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        stopping = false;
+        ready.clear();
+        for (auto& job : jobs) {
+            job->queued = job->runningNow = job->rerun = false;
+            job->polling = job->config.polling;
+            job->mgr->resumeRuns();
+        }
+        std::fill(deviceScans.begin(), deviceScans.end(), 0);
+    }
+
+    // 同一个卷上的轮询作业把第一次扫描均匀错开到各自的间隔里，之后每次从上次结束时重新计时，不会再对齐
+    std::vector<int> pollersOnDevice(deviceScans.size(), 0);
+    for (const auto& job : jobs) {
+        if (job->config.polling) ++pollersOnDevice[job->device];
+    }
+    std::vector<int> placed(deviceScans.size(), 0);
+
+    wheel.reset(GetTickCount64());
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        Job& job = *jobs[i];
+        if (job.config.polling) {
+            // 第一次轮询建立快照（与单作业的轮询模式一样，会先备份一次）
+            int k = placed[job.device]++;
+            wheel.add(i, (uint64_t)job.config.pollingInterval * k / pollersOnDevice[job.device]);
+            continue;
+        }
+
+        job.hDir = CreateFileW(job.watchDir.c_str(), FILE_LIST_DIRECTORY,
+                               FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+                               FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+        if (job.hDir == INVALID_HANDLE_VALUE ||
+            !CreateIoCompletionPort(job.hDir, iocp, JOB_KEY_BASE + i, 0)) {
+            note(L"[" + job.config.name + L"] 无法监听目录，该作业改为轮询: " + job.watchDir, LogLevel::Warning);
+            if (job.hDir != INVALID_HANDLE_VALUE) CloseHandle(job.hDir);
+            job.hDir = INVALID_HANDLE_VALUE;
+            {
+                std::lock_guard<std::mutex> lk(mtx);
+                job.polling = true;
+            }
+            wheel.add(i, 0);
+            continue;
+        }
+        job.buffer.assign(NOTIFY_BUFFER_SIZE / sizeof(DWORD), 0);
+        armWatch(job);
+    }
+
+    running = true;
+    watcher = std::thread(&JobEngine::watchLoop, this);
+    for (int i = 0; i < workerCount; ++i) {
+        workers.emplace_back(&JobEngine::workerLoop, this);
+    }
+    note(L"引擎已启动");
+    return true;
+}
+
+void JobEngine::stop() {
+    if (!running.load()) return;
+
+    // 先停监听线程（它会取消并收回所有目录监听），再取消各作业正在进行的备份、等工作线程退出
+    PostQueuedCompletionStatus(iocp, 0, KEY_STOP, NULL);
+    if (watcher.joinable()) watcher.join();
+
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        stopping = true;
+        ready.clear();
+    }
+    cv.notify_all();
+    // 正在备份的作业在当前文件（大文件为当前数据块）之后中止，不必等它整个拷完
+    for (auto& job : jobs) job->mgr->abortRuns();
+    for (auto& w : workers) {
+        if (w.joinable()) w.join();
+    }
+    workers.clear();
+
+    CloseHandle(iocp);
+    iocp = NULL;
+    running = false;
+    note(L"引擎已停止");
+    logger->flush();
+}
+
+bool JobEngine::armWatch(Job& job) {
+    job.ov = OVERLAPPED();
+    BOOL ok = ReadDirectoryChangesW(job.hDir, job.buffer.data(), (DWORD)(job.buffer.size() * sizeof(DWORD)),
+                                    job.sourceIsDirectory, NOTIFY_FILTER, NULL, &job.ov, NULL);
+    job.ioPending = ok != 0;
+    if (!ok) {
+        note(L"[" + job.config.name + L"] 启动目录监听失败: " + job.watchDir, LogLevel::Error);
+    }
+    return job.ioPending;
+}
+
+void JobEngine::handleNotify(size_t index, DWORD bytes, uint64_t arrivedAt) {
+    Job& job = *jobs[index];
+
+    // 缓冲区溢出时 bytes 为 0，不知道具体改了什么，按有变化处理
+    bool matched = bytes == 0;
+    const BYTE* base = (const BYTE*)job.buffer.data();
+    DWORD offset = 0;
+    while (bytes > 0 && offset < bytes) {
+        const FILE_NOTIFY_INFORMATION* fni = (const FILE_NOTIFY_INFORMATION*)(base + offset);
+        job.mgr->metrics.eventsReceived.add();
+        if (job.sourceIsDirectory) {
+            matched = true;
+        } else if (fni->Action == FILE_ACTION_MODIFIED || fni->Action == FILE_ACTION_ADDED ||
+                   fni->Action == FILE_ACTION_RENAMED_NEW_NAME) {
+            std::wstring name(fni->FileName, fni->FileNameLength / sizeof(WCHAR));
+            if (ToLower(name) == job.fileNameLower) matched = true;
+        }
+        if (fni->NextEntryOffset == 0) break;
+        offset += fni->NextEntryOffset;
+    }
+
+    if (matched) schedule(index, arrivedAt, false);
+}
+
+void JobEngine::watchLoop() {
+    std::vector<uint64_t> expired;
+    bool stopRequested = false;
+
+    for (;;) {
+        DWORD timeout = wheel.nextTimeoutMs(GetTickCount64());
+        if (stopRequested) timeout = 1000;  // 只等已取消的监听回来
+
+        DWORD bytes = 0;
+        ULONG_PTR key = 0;
+        OVERLAPPED* ov = NULL;
+        BOOL ok = GetQueuedCompletionStatus(iocp, &bytes, &key, &ov, timeout == UINT32_MAX ? INFINITE : timeout);
+        uint64_t arrivedAt = MetricsNowMicros();
+
+        if (ov == NULL && !ok) {
+            // 超时：走时间轮，或者停止时取消的监听迟迟不回来
+            if (stopRequested) break;
+        } else if (key == KEY_STOP) {
+            stopRequested = true;
+            for (auto& job : jobs) {
+                if (job->ioPending) CancelIoEx(job->hDir, &job->ov);
+            }
+        } else if (key == KEY_REARM_TIMER) {
+            if (!stopRequested) wheel.add(bytes, jobs[bytes]->config.pollingInterval);
+        } else if (key >= JOB_KEY_BASE && key - JOB_KEY_BASE < jobs.size()) {
+            size_t index = (size_t)(key - JOB_KEY_BASE);
+            Job& job = *jobs[index];
+            job.ioPending = false;
+            if (!stopRequested) {
+                if (ok) handleNotify(index, bytes, arrivedAt);
+                // 先处理再重新发起监听；两次之间的改动会留在系统缓冲里，不会丢
+                if (!armWatch(job)) {
+                    // 与启动时打不开目录一样改为轮询，否则这个作业再也不会备份
+                    note(L"[" + job.config.name + L"] 目录监听中断，该作业改为轮询: " + job.watchDir, LogLevel::Warning);
+                    CloseHandle(job.hDir);
+                    job.hDir = INVALID_HANDLE_VALUE;
+                    {
+                        std::lock_guard<std::mutex> lk(mtx);
+                        job.polling = true;
+                    }
+                    wheel.add(index, job.config.pollingInterval);
+                }
+            }
+        }
+
+        if (stopRequested) {
+            bool pending = false;
+            for (auto& job : jobs) pending = pending || job->ioPending;
+            if (!pending) break;
+            continue;
+        }
+
+        expired.clear();
+        wheel.advance(GetTickCount64(), expired);
+        for (uint64_t index : expired) {
+            schedule((size_t)index, 0, true);
+        }
+    }
+
+    for (auto& job : jobs) {
+        if (job->hDir != INVALID_HANDLE_VALUE) {
+            CloseHandle(job->hDir);
+            job->hDir = INVALID_HANDLE_VALUE;
+        }
+    }
+}
+
+void JobEngine::schedule(size_t index, uint64_t detectedAt, bool scanOnly) {
+    std::lock_guard<std::mutex> lk(mtx);
+    if (stopping) return;
+    Job& job = *jobs[index];
+
+    // 保留最早一次尚未处理的变化时间，延迟按它计算
+    auto merge = [&]() {
+        if (detectedAt != 0 && (job.detectedAt == 0 || detectedAt < job.detectedAt)) job.detectedAt = detectedAt;
+        if (!scanOnly) job.scanOnly = false;
+        if (detectedAt == 0 && !scanOnly) job.urgent = true;
+    };
+
+    if (job.runningNow) {
+        if (!job.rerun) {
+            job.rerun = true;
+            job.detectedAt = 0;
+            job.scanOnly = true;
+            job.urgent = false;
+        }
+        merge();
+        return;
+    }
+    if (job.queued) {
+        merge();
+        if (job.urgent && job.deferredSince != 0) cv.notify_one();  // 正在因负载推迟的话立即运行
+        return;
+    }
+
+    job.queued = true;
+    job.detectedAt = detectedAt;
+    job.scanOnly = scanOnly;
+    job.urgent = detectedAt == 0 && !scanOnly;
+    job.deferredSince = 0;
+    // 空闲过一段时间的作业不能凭积攒的虚拟时间长期插队
+    job.vtime = std::max(job.vtime, virtualNow);
+    ready.emplace(job.vtime, readySeq++, index);
+    cv.notify_one();
+}
+
+std::set<std::tuple<double, uint64_t, size_t>>::iterator JobEngine::pickReady(bool& deferred) {
+    const uint64_t now = MetricsNowMicros();
+    const uint64_t maxDefer = (uint64_t)std::max(0, loadGate.limits().maxDeferSeconds) * 1000000;
+
+    // 只在遇到非手动作业时才检查负载，每次最多检查一次
+    std::wstring reason;
+    int loadBusy = -1;
+
+    // 按虚拟时间从小到大，跳过所在卷上已经有扫描在跑的轮询扫描，以及系统繁忙时还能再等的自动作业
+    for (auto it = ready.begin(); it != ready.end(); ++it) {
+        Job& job = *jobs[std::get<2>(*it)];
+        if (job.scanOnly && deviceScans[job.device] != 0) continue;
+        if (!job.urgent && loadBusy < 0) loadBusy = loadGate.busy(&reason) ? 1 : 0;
+        if (!job.urgent && loadBusy) {
+            if (job.deferredSince == 0) {
+                job.deferredSince = now;
+                job.mgr->metrics.backupsDeferred.add();
+                note(L"[" + job.config.name + L"] 系统繁忙（" + reason + L"），推迟运行");
+            }
+            if (now - job.deferredSince < maxDefer) {
+                deferred = true;
+                continue;
+            }
+        }
+        return it;
+    }
+    return ready.end();
+}
+
+void JobEngine::workerLoop() {
+    for (;;) {
+        size_t index;
+        bool scanOnly;
+        uint64_t detectedAt;
+        {
+            std::unique_lock<std::mutex> lk(mtx);
+            if (stopping) return;
+            bool deferred = false;
+            auto next = pickReady(deferred);
+            if (next == ready.end()) {
+                // 因负载推迟的作业不会有别的事件唤醒，定时重新检查负载
+                if (deferred) cv.wait_for(lk, std::chrono::seconds(LOAD_RECHECK_SECONDS));
+                else cv.wait(lk);
+                continue;
+            }
+
+            index = std::get<2>(*next);
+            virtualNow = std::max(virtualNow, std::get<0>(*next));
+            ready.erase(next);
+
+            Job& job = *jobs[index];
+            job.queued = false;
+            job.runningNow = true;
+            scanOnly = job.scanOnly;
+            detectedAt = job.detectedAt;
+            job.detectedAt = 0;
+            if (scanOnly) ++deviceScans[job.device];
+            if (job.deferredSince != 0) {
+                uint64_t waited = MetricsNowMicros() - job.deferredSince;
+                job.deferredSince = 0;
+                job.mgr->metrics.deferDuration.record(waited);
+                note(L"[" + job.config.name + L"] 推迟 " + std::to_wstring(waited / 1000000) + L" 秒后开始运行");
+            }
+        }
+        runJob(index, scanOnly, detectedAt);
+    }
+}
+
+void JobEngine::runJob(size_t index, bool scanOnly, uint64_t detectedAt) {
+    Job& job = *jobs[index];
+    uint64_t start = MetricsNowMicros();
+    try {
+        BackupManager& mgr = *job.mgr;
+        if (scanOnly) {
+            mgr.metrics.pollScans.add();
+            if (GetFileAttributesW(job.config.source.c_str()) == INVALID_FILE_ATTRIBUTES) {
+                note(L"[" + job.config.name + L"] 源路径无效或不存在: " + job.config.source, LogLevel::Warning);
+            } else if (mgr.scanForChanges()) {
+                mgr.backupAfterChange(start);
+            }
+        } else if (detectedAt != 0) {
+            mgr.backupAfterChange(detectedAt);
+        } else {
+            mgr.backupFile();
+        }
+    } catch (...) {
+        note(L"[" + job.config.name + L"] 执行作业时出错", LogLevel::Error);
+    }
+    uint64_t elapsed = MetricsNowMicros() - start;
+
+    bool polling;
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        polling = job.polling;
+        job.runningNow = false;
+        if (scanOnly) --deviceScans[job.device];
+        job.lastRunMicros = elapsed;
+        ++job.runs;
+        // 按实际耗时记账（至少 1 ms），权重越大虚拟时间涨得越慢
+        job.vtime += std::max<uint64_t>(elapsed, 1000) / 1000.0 / job.weight;
+
+        if (job.rerun && !stopping) {
+            job.rerun = false;
+            job.queued = true;
+            job.vtime = std::max(job.vtime, virtualNow);
+            ready.emplace(job.vtime, readySeq++, index);
+        }
+    }
+    // 卷空出来后，之前被跳过的扫描可能可以运行了
+    cv.notify_all();
+
+    // 轮询间隔从本次结束时算起（与单作业轮询一致），交给监听线程重新计时
+    if (polling && scanOnly && running.load()) {
+        PostQueuedCompletionStatus(iocp, (DWORD)index, KEY_REARM_TIMER, NULL);
+    }
+}
+
+bool JobEngine::trigger(const std::wstring& name) {
+    bool found = false;
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        if (name.empty() || jobs[i]->config.name == name) {
+            found = true;
+            if (running.load()) schedule(i, 0, false);
+        }
+    }
+    return found && running.load();
+}
+
+std::string JobEngine::status() const {
+    std::string text;
+    char buf[256];
+    snprintf(buf, sizeof(buf), "running=%d\njobs=%zu\nworkers=%d\n", running.load() ? 1 : 0, jobs.size(), workerCount);
+    text += buf;
+
+    std::lock_guard<std::mutex> lk(mtx);
+    snprintf(buf, sizeof(buf), "ready=%zu\n", ready.size());
+    text += buf;
+    for (const auto& job : jobs) {
+        const char* state = job->runningNow ? "running" : job->deferredSince != 0 ? "deferred" : job->queued ? "queued" : "idle";
+        const BackupMetrics& m = job->mgr->metrics;
+        snprintf(buf, sizeof(buf), " mode=%s priority=%d state=%s runs=%llu backups=%llu last_ms=%.1f p99_ms=%.1f\n",
+                 job->polling ? "polling" : "event",
+                 job->config.priority, state, (unsigned long long)job->runs,
+                 (unsigned long long)m.backupsTriggered.get(), job->lastRunMicros / 1000.0,
+                 m.changeToCommit.valueAt(0.99) / 1000.0);
+        text += "job=" + ToUtf8(job->config.name) + buf;
+    }
+    return text;
+}
+
+std::string JobEngine::metrics() const {
+    std::vector<std::pair<std::wstring, const BackupMetrics*>> sets;
+    for (const auto& job : jobs) {
+        sets.emplace_back(job->config.name, &job->mgr->metrics);
+    }
+    return BackupMetrics::ToPrometheus(sets);
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <set>
+#include <tuple>
+#include <windows.h>
+#include "backup.h"
+#include "timerwheel.h"
+#include "loadgate.h"
+
+// 默认的作业文件名（位于程序目录）
+const wchar_t JOBS_FILE_NAME[] = L"jobs.ini";
+
+const int JOB_PRIORITY_LOWEST = 0;
+const int JOB_PRIORITY_NORMAL = 2;
+const int JOB_PRIORITY_HIGHEST = 4;
+
+// 一个作业：一个源路径备份到若干目标
+struct JobConfig {
+    std::wstring name;
+    std::wstring source;
+    std::vector<std::wstring> targets;
+    bool polling = false;
+    bool incremental = false;
+    int pollingInterval = 3000;
+    int maxBackupCount = 10;
+    int quotaMB = 0;
+    int priority = JOB_PRIORITY_NORMAL;  // 0 ~ 4，每高一级，排队时分到的备份时间翻倍
+    bool lowPriority = true;             // 备份时工作线程进入后台模式（低 CPU 与磁盘 I/O 优先级）
+};
+
+// jobs.ini：第一节之前是全局设置，之后每节一个作业，例如
+//   WORKERS=4
+//   LOG_LEVEL=info
+//   LOAD_GATE=1               （系统繁忙时推迟自动备份，默认关闭；另有 LOAD_CPU、LOAD_DISK_QUEUE、LOAD_ON_BATTERY、LOAD_MAX_DEFER）
+//   [项目A]
+//   SOURCE=D:\Projects\A
+//   TARGET=E:\Backup          （可写多行）
+//   INCREMENTAL=1
+//   POLLING=0
+//   POLLING_INTERVAL=3000
+//   MAX_BACKUP_COUNT=10
+//   QUOTA_MB=0
+//   PRIORITY=2
+//   LOW_PRIORITY=1
+struct JobsFile {
+    int workers = 0;  // 0 表示按 CPU 数决定（最多 4 个）
+    LogLevel logLevel = LogLevel::Info;
+    LoadLimits load;
+    std::vector<JobConfig> jobs;
+};
+
+bool LoadJobs(const std::wstring& path, JobsFile& out, std::wstring& error);
+
+// 多作业引擎：一个进程里运行任意多个作业，共用
+//   - 一个监听线程：所有事件模式作业的目录句柄关联到同一个完成端口，轮询作业的间隔由时间轮管理；
+//   - 一个 I/O 线程池：发现变化的作业进入就绪队列，由固定数量的工作线程执行扫描和备份；
+//   - 一份日志（backup.log）和一个清理线程。
+// 就绪队列按虚拟时间公平调度（开始时间公平排队）：作业每运行一次，虚拟时间增加 耗时 / 权重，
+// 总是先运行虚拟时间最小的作业，优先级高的作业权重大，但低优先级的作业也不会饿死。
+// 同一作业同时最多运行一次；运行中又发生的变化合并为结束后的一次重跑。
+// PRIORITY 只决定作业之间的排队顺序；LOW_PRIORITY 决定备份时相对于其他程序的 CPU 与磁盘优先级，
+// 监听线程不受影响，始终以正常优先级接收通知。
+// 轮询作业的间隔由分层时间轮管理，不为每个作业开线程；同一个卷上的轮询扫描错开开始时间，
+// 且同时最多运行一个，避免多个扫描争抢同一块磁盘。
+// 系统繁忙时，由变化或轮询发起的作业留在队列里推迟运行（最长 LOAD_MAX_DEFER 秒），手动触发的照常运行。
+class JobEngine {
+public:
+    JobEngine();
+    ~JobEngine();
+
+    JobEngine(const JobEngine&) = delete;
+    JobEngine& operator=(const JobEngine&) = delete;
+
+    // 只能在未运行时调用；替换现有的全部作业
+    bool load(const std::wstring& path, std::wstring& error);
+
+    bool start();
+    void stop();
+    bool isRunning() const { return running.load(); }
+
+    // 立即备份指定作业，name 为空时备份全部作业；找不到作业时返回 false
+    bool trigger(const std::wstring& name);
+
+    size_t jobCount() const { return jobs.size(); }
+
+    // 每个作业一行 key=value 形式的状态（UTF-8）
+    std::string status() const;
+
+    // 所有作业的指标，Prometheus 文本格式，带 job 标签
+    std::string metrics() const;
+
+private:
+    struct Job;
+
+    void watchLoop();
+    void workerLoop();
+
+    bool armWatch(Job& job);
+    void handleNotify(size_t index, DWORD bytes, uint64_t arrivedAt);
+
+    // 作业有变化（scanOnly 为轮询到期，只需先扫描）时放入就绪队列，已在排队或运行中时合并
+    void schedule(size_t index, uint64_t detectedAt, bool scanOnly);
+    void runJob(size_t index, bool scanOnly, uint64_t detectedAt);
+    // 系统繁忙时跳过未到最长推迟时间的非手动作业，并置 deferred；负载只在需要时检查
+    std::set<std::tuple<double, uint64_t, size_t>>::iterator pickReady(bool& deferred);
+
+    void note(const std::wstring& msg, LogLevel level = LogLevel::Info);
+
+    std::shared_ptr<AsyncLogger> logger;
+    std::shared_ptr<PruneWorker> pruner;
+    std::vector<std::unique_ptr<Job>> jobs;
+    int workerCount = 1;
+
+    std::atomic<bool> running{ false };
+    HANDLE iocp = NULL;
+    std::thread watcher;
+    std::vector<std::thread> workers;
+    TimerWheel wheel;  // 只由监听线程访问
+    LoadGate loadGate;
+
+    // 就绪队列和各作业的调度状态
+    mutable std::mutex mtx;
+    std::condition_variable cv;
+    std::set<std::tuple<double, uint64_t, size_t>> ready;  // (虚拟时间, 入队序号, 作业下标)
+    double virtualNow = 0;   // 最近一次开始运行的作业的虚拟时间
+    uint64_t readySeq = 0;
+    std::vector<int> deviceScans;  // 每个卷上正在运行的轮询扫描数
+    bool stopping = false;
+};
@@ -0,0 +1,96 @@
+#include "loadgate.h"
+#include <pdh.h>
+#include <cstdio>
+
+static uint64_t FileTimeValue(const FILETIME& ft) {
+    return ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+}
+
+LoadGate::LoadGate() {}
+
+LoadGate::~LoadGate() {
+    if (query) PdhCloseQuery(query);
+}
+
+void LoadGate::setLimits(const LoadLimits& limits) {
+    std::lock_guard<std::mutex> lk(mtx);
+    cfg = limits;
+}
+
+LoadLimits LoadGate::limits() const {
+    std::lock_guard<std::mutex> lk(mtx);
+    return cfg;
+}
+
+void LoadGate::sample(uint64_t now) {
+    sampledAt = now;
+
+    // 内核时间包含空闲时间
+    FILETIME idleTime, kernelTime, userTime;
+    if (GetSystemTimes(&idleTime, &kernelTime, &userTime)) {
+        uint64_t idle = FileTimeValue(idleTime);
+        uint64_t total = FileTimeValue(kernelTime) + FileTimeValue(userTime);
+        if (lastTotal != 0 && total > lastTotal) {
+            uint64_t busyTicks = (total - lastTotal) - (idle - lastIdle);
+            cpu = (int)(busyTicks * 100 / (total - lastTotal));
+        }
+        lastIdle = idle;
+        lastTotal = total;
+    }
+
+    // 英文计数器名在任何语言的系统上都可用；第一次收集只建立基准，之后才有平均值
+    if (!pdhTried) {
+        pdhTried = true;
+        PDH_HQUERY q = NULL;
+        PDH_HCOUNTER c = NULL;
+        if (PdhOpenQueryW(NULL, 0, &q) == ERROR_SUCCESS) {
+            if (PdhAddEnglishCounterW(q, L"\\PhysicalDisk(_Total)\\Avg. Disk Queue Length", 0, &c) == ERROR_SUCCESS) {
+                query = q;
+                counter = c;
+            } else {
+                PdhCloseQuery(q);
+            }
+        }
+    }
+    if (query && PdhCollectQueryData(query) == ERROR_SUCCESS) {
+        PDH_FMT_COUNTERVALUE value;
+        if (PdhGetFormattedCounterValue(counter, PDH_FMT_DOUBLE, NULL, &value) == ERROR_SUCCESS) {
+            queue = value.doubleValue;
+        }
+    }
+
+    SYSTEM_POWER_STATUS power;
+    onBattery = GetSystemPowerStatus(&power) && power.ACLineStatus == 0;
+}
+
+bool LoadGate::busy(std::wstring* reason) {
+    std::lock_guard<std::mutex> lk(mtx);
+    if (!cfg.enabled) return false;
+
+    // 结果是上次采样以来的平均；窗口太短时沿用上一个窗口，不在这里等待
+    uint64_t now = GetTickCount64();
+    if (sampledAt == 0 || now - sampledAt >= 1000) {
+        sample(now);
+    }
+
+    wchar_t buf[64];
+    if (cfg.deferOnBattery && onBattery) {
+        if (reason) *reason = L"使用电池供电";
+        return true;
+    }
+    if (cfg.cpuPercent > 0 && cpu >= cfg.cpuPercent) {
+        if (reason) {
+            swprintf(buf, 64, L"CPU %d%%", cpu);
+            *reason = buf;
+        }
+        return true;
+    }
+    if (cfg.diskQueue > 0 && queue >= cfg.diskQueue) {
+        if (reason) {
+            swprintf(buf, 64, L"磁盘队列 %.1f", queue);
+            *reason = buf;
+        }
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+#include <mutex>
+#include <cstdint>
+#include <windows.h>
+
+// 系统负载门限：任一项超过时推迟非紧急的备份（监听或轮询发现变化后自动发起的），
+// 手动备份不受限制。推迟最多 maxDeferSeconds 秒，之后不管负载照常备份，不会无限期地拖下去。
+// 默认不启用，需在配置中写 LOAD_GATE=1。
+struct LoadLimits {
+    bool enabled = false;
+    int cpuPercent = 90;         // 全部 CPU 的平均占用（%），0 表示不检查
+    int diskQueue = 4;           // 所有物理磁盘的平均队列长度，0 表示不检查
+    bool deferOnBattery = true;  // 使用电池供电时推迟
+    int maxDeferSeconds = 900;
+};
+
+const int LOAD_RECHECK_SECONDS = 5;  // 推迟期间多久重新检查一次负载
+
+// 采样系统负载：CPU 占用由相邻两次 GetSystemTimes 之差计算，磁盘队列来自性能计数器
+// \PhysicalDisk(_Total)\Avg. Disk Queue Length（同样取两次采样之间的平均），电源来自 GetSystemPowerStatus。
+// 两次采样至少间隔 1 秒，期间的调用直接返回上次的结果；busy() 从不等待，结果是距上次采样这段时间的平均，
+// 第一次调用只建立基准（此时只检查电源）。推迟期间每 LOAD_RECHECK_SECONDS 秒检查一次，窗口也就是这么长。
+// 计数器不可用时只检查其余几项。线程安全。
+class LoadGate {
+public:
+    LoadGate();
+    ~LoadGate();
+
+    LoadGate(const LoadGate&) = delete;
+    LoadGate& operator=(const LoadGate&) = delete;
+
+    void setLimits(const LoadLimits& limits);
+    LoadLimits limits() const;
+
+    // 当前负载是否超过门限（未启用时总是 false）；超过时 reason 为原因，例如 "CPU 97%"
+    bool busy(std::wstring* reason = nullptr);
+
+private:
+    void sample(uint64_t now);
+
+    mutable std::mutex mtx;
+    LoadLimits cfg;
+
+    uint64_t sampledAt = 0;   // GetTickCount64，0 表示还没有采样过
+    uint64_t lastIdle = 0;
+    uint64_t lastTotal = 0;
+    int cpu = -1;             // 最近一次的 CPU 占用（%），-1 表示还不知道
+    double queue = -1;        // 最近一次的磁盘队列长度，-1 表示不可用
+    bool onBattery = false;
+
+    HANDLE query = NULL;      // PDH_HQUERY
+    HANDLE counter = NULL;    // PDH_HCOUNTER
+    bool pdhTried = false;
+};
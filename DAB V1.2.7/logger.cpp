@@ -0,0 +1,380 @@
+#include "logger.h"
+#include <windows.h>
+#include <cstdio>
+#include <cwchar>
+#include <algorithm>
+
+namespace {
+
+size_t RoundUpPowerOfTwo(size_t n) {
+    size_t v = 2;
+    while (v < n) v <<= 1;
+    return v;
+}
+
+int64_t CurrentFileTime() {
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+    return ((int64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+}
+
+// "backup.log" -> ("backup", ".log")
+void SplitExtension(const std::wstring& path, std::wstring& stem, std::wstring& ext) {
+    size_t slash = path.find_last_of(L"\\/");
+    size_t dot = path.find_last_of(L'.');
+    if (dot == std::wstring::npos || (slash != std::wstring::npos && dot < slash)) {
+        stem = path;
+        ext.clear();
+    } else {
+        stem = path.substr(0, dot);
+        ext = path.substr(dot);
+    }
+}
+
+// 归档名中间的时间戳部分是否为 YYYYMMDD_HHMMSS
+bool IsArchiveStamp(const wchar_t* s, size_t len) {
+    if (len != 15 || s[8] != L'_') return false;
+    for (size_t i = 0; i < len; ++i) {
+        if (i != 8 && (s[i] < L'0' || s[i] > L'9')) return false;
+    }
+    return true;
+}
+
+// 用 NTFS 压缩归档文件：归档仍是普通文本文件，任何工具都能直接打开；
+// 非 NTFS 卷上会失败，此时保持不压缩
+bool CompressArchive(const std::wstring& path) {
+    HANDLE h = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+    if (h == INVALID_HANDLE_VALUE) return false;
+    USHORT format = COMPRESSION_FORMAT_DEFAULT;
+    DWORD returned = 0;
+    BOOL ok = DeviceIoControl(h, FSCTL_SET_COMPRESSION, &format, sizeof(format), NULL, 0, &returned, NULL);
+    CloseHandle(h);
+    return ok != FALSE;
+}
+
+void AppendUtf8(const std::wstring& text, std::string& out) {
+    if (text.empty()) return;
+    int len = WideCharToMultiByte(CP_UTF8, 0, text.data(), (int)text.size(), NULL, 0, NULL, NULL);
+    if (len <= 0) return;
+    size_t pos = out.size();
+    out.resize(pos + len);
+    WideCharToMultiByte(CP_UTF8, 0, text.data(), (int)text.size(), &out[pos], len, NULL, NULL);
+}
+
+} // namespace
+
+LogLevel ParseLogLevel(const std::wstring& name, LogLevel fallback) {
+    if (_wcsicmp(name.c_str(), L"debug") == 0) return LogLevel::Debug;
+    if (_wcsicmp(name.c_str(), L"info") == 0) return LogLevel::Info;
+    if (_wcsicmp(name.c_str(), L"warning") == 0) return LogLevel::Warning;
+    if (_wcsicmp(name.c_str(), L"error") == 0) return LogLevel::Error;
+    return fallback;
+}
+
+const wchar_t* LogLevelName(LogLevel level) {
+    switch (level) {
+    case LogLevel::Debug: return L"debug";
+    case LogLevel::Warning: return L"warning";
+    case LogLevel::Error: return L"error";
+    default: return L"info";
+    }
+}
+
+AsyncLogger::AsyncLogger(const std::wstring& path, size_t capacity)
+    : filePath(path), slots(RoundUpPowerOfTwo(capacity)) {
+    mask = slots.size() - 1;
+    for (size_t i = 0; i < slots.size(); ++i) {
+        slots[i].seq.store(i, std::memory_order_relaxed);
+    }
+    hWake = CreateEventW(NULL, FALSE, FALSE, NULL);
+    worker = std::thread(&AsyncLogger::run, this);
+}
+
+AsyncLogger::~AsyncLogger() {
+    stop();
+    if (hWake) CloseHandle(hWake);
+}
+
+bool AsyncLogger::write(std::wstring msg, LogLevel level) {
+    if (!enabled(level)) return false;
+
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+
+    // 有界 MPSC 队列：每个槽位的序号表明它当前可写（== pos）还是可读（== pos + 1）
+    size_t pos = enqueuePos.load(std::memory_order_relaxed);
+    Slot* slot;
+    for (;;) {
+        slot = &slots[pos & mask];
+        size_t seq = slot->seq.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else if (diff < 0) {
+            // 队列已满：丢弃新消息，而不是阻塞备份线程
+            droppedCount.fetch_add(1, std::memory_order_relaxed);
+            SetEvent(hWake);
+            return false;
+        } else {
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->time = ((int64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+    slot->text = std::move(msg);
+    slot->seq.store(pos + 1, std::memory_order_release);
+
+    // 后台线程取空队列后才会去等待，只有这时（队列由空变为非空）需要唤醒它；
+    // 它正在写文件时到达的消息留给下一批，不再每条都 SetEvent
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (idle.load(std::memory_order_relaxed) && idle.exchange(false)) SetEvent(hWake);
+    return true;
+}
+
+void AsyncLogger::flush() {
+    if (!worker.joinable()) return;
+    size_t target = enqueuePos.load(std::memory_order_acquire);
+    SetEvent(hWake);
+    std::unique_lock<std::mutex> lk(flushMtx);
+    flushCv.wait(lk, [&]() { return flushedPos >= target; });
+}
+
+void AsyncLogger::stop() {
+    if (!worker.joinable()) return;
+    stopping.store(true);
+    SetEvent(hWake);
+    worker.join();
+    {
+        std::lock_guard<std::mutex> lk(flushMtx);
+        flushedPos = enqueuePos.load();
+    }
+    flushCv.notify_all();
+
+    {
+        std::lock_guard<std::mutex> lk(archiveMtx);
+        archiveStopping = true;
+    }
+    archiveCv.notify_one();
+    if (archiver.joinable()) archiver.join();
+}
+
+void AsyncLogger::setRotation(const LogRotation& value) {
+    std::lock_guard<std::mutex> lk(rotationMtx);
+    rotation = value;
+}
+
+void AsyncLogger::appendTimestamp(int64_t time, std::string& out) {
+    int64_t second = time / 10000000;
+    if (second != cachedSecond) {
+        FILETIME utc, local;
+        utc.dwLowDateTime = (DWORD)time;
+        utc.dwHighDateTime = (DWORD)(time >> 32);
+        SYSTEMTIME st;
+        FileTimeToLocalFileTime(&utc, &local);
+        FileTimeToSystemTime(&local, &st);
+
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "[%04u-%02u-%02u %02u:%02u:%02u] ",
+                      (unsigned)st.wYear, (unsigned)st.wMonth, (unsigned)st.wDay,
+                      (unsigned)st.wHour, (unsigned)st.wMinute, (unsigned)st.wSecond);
+        cachedStamp = buf;
+        cachedSecond = second;
+    }
+    out += cachedStamp;
+}
+
+size_t AsyncLogger::drain(std::string& out) {
+    size_t count = 0;
+    for (;;) {
+        Slot& slot = slots[dequeuePos & mask];
+        if (slot.seq.load(std::memory_order_acquire) != dequeuePos + 1) break;
+
+        appendTimestamp(slot.time, out);
+        AppendUtf8(slot.text, out);
+        out += "\r\n";
+        slot.text.clear();
+
+        slot.seq.store(dequeuePos + mask + 1, std::memory_order_release);
+        ++dequeuePos;
+        ++count;
+    }
+
+    uint64_t dropped = droppedCount.load(std::memory_order_relaxed);
+    if (dropped != droppedReported) {
+        FILETIME ft;
+        GetSystemTimeAsFileTime(&ft);
+        appendTimestamp(((int64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime, out);
+        AppendUtf8(L"[日志] 队列已满，丢弃了 " + std::to_wstring(dropped - droppedReported) +
+                   L" 条日志（累计 " + std::to_wstring(dropped) + L" 条）", out);
+        out += "\r\n";
+        droppedReported = dropped;
+    }
+    return count;
+}
+
+bool AsyncLogger::openFile() {
+    hFile = CreateFileW(filePath.c_str(), FILE_APPEND_DATA | FILE_READ_ATTRIBUTES | FILE_WRITE_ATTRIBUTES,
+                        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                        NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER size;
+    fileBytes = GetFileSizeEx(hFile, &size) ? (unsigned long long)size.QuadPart : 0;
+
+    FILETIME created;
+    if (fileBytes == 0) {
+        // 新建的文件可能因 NTFS 的文件名隧道沿用刚改名的旧文件的创建时间，这里显式改成现在
+        fileCreated = CurrentFileTime();
+        created.dwLowDateTime = (DWORD)fileCreated;
+        created.dwHighDateTime = (DWORD)(fileCreated >> 32);
+        SetFileTime(hFile, &created, NULL, NULL);
+    } else if (GetFileTime(hFile, &created, NULL, NULL)) {
+        fileCreated = ((int64_t)created.dwHighDateTime << 32) | created.dwLowDateTime;
+    } else {
+        fileCreated = CurrentFileTime();
+    }
+    return true;
+}
+
+void AsyncLogger::rotate() {
+    CloseHandle(hFile);
+    hFile = INVALID_HANDLE_VALUE;
+
+    SYSTEMTIME st;
+    GetLocalTime(&st);
+    wchar_t stamp[32];
+    swprintf(stamp, 32, L".%04u%02u%02u_%02u%02u%02u", (unsigned)st.wYear, (unsigned)st.wMonth, (unsigned)st.wDay,
+             (unsigned)st.wHour, (unsigned)st.wMinute, (unsigned)st.wSecond);
+
+    std::wstring stem, ext;
+    SplitExtension(filePath, stem, ext);
+    std::wstring archivePath = stem + stamp + ext;
+
+    // 改名失败（例如被其他程序独占打开）时继续写原文件，下一批再试
+    if (MoveFileExW(filePath.c_str(), archivePath.c_str(), 0)) {
+        {
+            std::lock_guard<std::mutex> lk(archiveMtx);
+            archiveQueue.push_back(archivePath);
+            if (!archiver.joinable()) archiver = std::thread(&AsyncLogger::archiveLoop, this);
+        }
+        archiveCv.notify_one();
+    }
+    openFile();
+}
+
+void AsyncLogger::writeOut(const std::string& data) {
+    if (data.empty()) return;
+    if (hFile == INVALID_HANDLE_VALUE && !openFile()) return;  // 本批丢弃，下一批再尝试打开
+
+    LogRotation limits;
+    {
+        std::lock_guard<std::mutex> lk(rotationMtx);
+        limits = rotation;
+    }
+    const int64_t day = 24LL * 3600 * 10000000;
+    bool tooBig = limits.maxBytes > 0 && fileBytes > 0 && fileBytes + data.size() > limits.maxBytes;
+    bool tooOld = limits.maxAgeDays > 0 && fileBytes > 0 &&
+                  CurrentFileTime() - fileCreated >= limits.maxAgeDays * day;
+    if (tooBig || tooOld) {
+        rotate();
+        if (hFile == INVALID_HANDLE_VALUE) return;
+    }
+
+    DWORD written = 0;
+    WriteFile(hFile, data.data(), (DWORD)data.size(), &written, NULL);
+    fileBytes += written;
+}
+
+void AsyncLogger::archiveLoop() {
+    // 与清理旧备份一样以后台优先级运行，压缩大文件时不和备份抢磁盘
+    SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+
+    std::unique_lock<std::mutex> lk(archiveMtx);
+    for (;;) {
+        archiveCv.wait(lk, [this]() { return archiveStopping || !archiveQueue.empty(); });
+        if (archiveQueue.empty()) break;
+
+        std::vector<std::wstring> batch;
+        batch.swap(archiveQueue);
+        lk.unlock();
+
+        for (const auto& path : batch) {
+            CompressArchive(path);
+        }
+        pruneArchives();
+
+        lk.lock();
+    }
+}
+
+void AsyncLogger::pruneArchives() {
+    int keep;
+    {
+        std::lock_guard<std::mutex> lk(rotationMtx);
+        keep = rotation.keepArchives;
+    }
+    if (keep <= 0) return;
+
+    std::wstring stem, ext;
+    SplitExtension(filePath, stem, ext);
+    size_t slash = stem.find_last_of(L"\\/");
+    std::wstring dir = slash == std::wstring::npos ? L"" : stem.substr(0, slash + 1);
+    std::wstring prefix = stem.substr(slash == std::wstring::npos ? 0 : slash + 1) + L".";
+
+    // 归档名中的时间戳可以直接按字符串排序
+    std::vector<std::wstring> archives;
+    WIN32_FIND_DATAW ffd;
+    std::wstring pattern = stem + L".*" + ext;
+    HANDLE hFind = FindFirstFileExW(pattern.c_str(), FindExInfoBasic, &ffd, FindExSearchNameMatch, NULL, 0);
+    if (hFind == INVALID_HANDLE_VALUE) return;
+    do {
+        std::wstring name = ffd.cFileName;
+        if (name.size() != prefix.size() + 15 + ext.size()) continue;
+        if (_wcsnicmp(name.c_str(), prefix.c_str(), prefix.size()) != 0) continue;
+        if (!IsArchiveStamp(name.c_str() + prefix.size(), 15)) continue;
+        archives.push_back(name);
+    } while (FindNextFileW(hFind, &ffd));
+    FindClose(hFind);
+
+    if ((int)archives.size() <= keep) return;
+    std::sort(archives.begin(), archives.end());
+    for (size_t i = 0; i + keep < archives.size(); ++i) {
+        DeleteFileW((dir + archives[i]).c_str());
+    }
+}
+
+bool AsyncLogger::hasWork() const {
+    if (stopping.load() || droppedCount.load(std::memory_order_relaxed) != droppedReported) return true;
+    const Slot& slot = slots[dequeuePos & mask];
+    return slot.seq.load(std::memory_order_acquire) == dequeuePos + 1;
+}
+
+void AsyncLogger::run() {
+    std::string batch;
+    for (;;) {
+        // 先声明要去等待，再检查一遍队列：与 write() 中的屏障配对，
+        // 两边至少有一方能看到对方，不会在有消息时无限期地睡下去
+        idle.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!hasWork()) WaitForSingleObject(hWake, INFINITE);
+        idle.store(false, std::memory_order_relaxed);
+        bool last = stopping.load();
+
+        batch.clear();
+        drain(batch);
+        writeOut(batch);
+
+        {
+            std::lock_guard<std::mutex> lk(flushMtx);
+            flushedPos = dequeuePos;
+        }
+        flushCv.notify_all();
+
+        if (last) break;
+    }
+
+    if (hFile != INVALID_HANDLE_VALUE) {
+        CloseHandle(hFile);
+        hFile = INVALID_HANDLE_VALUE;
+    }
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include <windows.h>
+
+// 日志级别，低于当前级别的消息在入队前就被丢掉
+enum class LogLevel {
+    Debug = 0,  // 逐文件的细节（跳过/更新了哪个文件、每个目录事件）
+    Info,
+    Warning,
+    Error
+};
+
+// 配置文件中的级别名称：debug / info / warning / error
+LogLevel ParseLogLevel(const std::wstring& name, LogLevel fallback = LogLevel::Info);
+const wchar_t* LogLevelName(LogLevel level);
+
+// 日志轮转：当前文件超过 maxBytes 或写了 maxAgeDays 天后改名为 "name.YYYYMMDD_HHMMSS.ext" 归档
+// （对应项为 0 时不按该条件轮转），归档文件在后台压缩，最多保留 keepArchives 个。
+struct LogRotation {
+    unsigned long long maxBytes = 10ULL * 1024 * 1024;
+    int maxAgeDays = 0;
+    int keepArchives = 5;
+};
+
+// 异步日志：调用方只把消息放进无锁的多生产者单消费者环形队列，
+// 时间戳格式化、UTF-8 转换和写文件都在后台线程上成批完成，日志文件一直保持打开。
+// 队列满时直接丢弃新消息（内存占用有上限），丢弃的条数会作为一行日志补记到文件里。
+// 轮转也在后台线程上进行，压缩和清理旧归档另由归档线程完成，写日志的线程不会被阻塞。
+class AsyncLogger {
+public:
+    // capacity 会向上取整为 2 的幂
+    explicit AsyncLogger(const std::wstring& path, size_t capacity = 8192);
+    ~AsyncLogger();
+
+    AsyncLogger(const AsyncLogger&) = delete;
+    AsyncLogger& operator=(const AsyncLogger&) = delete;
+
+    // 任意线程调用，不加锁；级别不够或队列已满时丢弃并返回 false
+    bool write(std::wstring msg, LogLevel level = LogLevel::Info);
+
+    void setLevel(LogLevel level) { minLevel.store(level, std::memory_order_relaxed); }
+    void setRotation(const LogRotation& rotation);
+
+    // 调用方在拼接逐文件消息之前先检查，避免白白构造字符串
+    bool enabled(LogLevel level) const { return level >= minLevel.load(std::memory_order_relaxed); }
+
+    // 等待此前写入的消息全部落到文件中
+    void flush();
+
+    // 写完队列中剩余的消息后结束后台线程
+    void stop();
+
+    uint64_t dropped() const { return droppedCount.load(std::memory_order_relaxed); }
+
+private:
+    struct Slot {
+        std::atomic<size_t> seq;
+        int64_t time = 0;  // FILETIME（UTC），格式化推迟到后台线程
+        std::wstring text;
+    };
+
+    void run();
+    bool hasWork() const;
+    size_t drain(std::string& out);
+    void appendTimestamp(int64_t time, std::string& out);
+    void writeOut(const std::string& data);
+    bool openFile();
+    void rotate();
+    void archiveLoop();
+    void pruneArchives();
+
+    const std::wstring filePath;
+    std::vector<Slot> slots;
+    size_t mask;
+
+    alignas(64) std::atomic<size_t> enqueuePos{ 0 };
+    alignas(64) size_t dequeuePos = 0;  // 只由后台线程访问
+    std::atomic<LogLevel> minLevel{ LogLevel::Info };
+    std::atomic<uint64_t> droppedCount{ 0 };
+    uint64_t droppedReported = 0;
+
+    HANDLE hWake = NULL;                    // 唤醒后台线程的事件（自动重置）
+    std::atomic<bool> idle{ false };        // 后台线程已取空队列，正要或正在等待 hWake
+    HANDLE hFile = INVALID_HANDLE_VALUE;    // 日志文件句柄，打开失败时下一批再重试
+    unsigned long long fileBytes = 0;       // 当前日志文件大小
+    int64_t fileCreated = 0;                // 当前日志文件的创建时间（FILETIME）
+    std::thread worker;
+    std::atomic<bool> stopping{ false };
+
+    // 只用于 flush() 等待，不在写入路径上
+    std::mutex flushMtx;
+    std::condition_variable flushCv;
+    size_t flushedPos = 0;
+
+    std::mutex rotationMtx;
+    LogRotation rotation;
+
+    // 归档线程：压缩刚轮转出来的文件并删除多余的旧归档，第一次轮转时才启动
+    std::thread archiver;
+    std::mutex archiveMtx;
+    std::condition_variable archiveCv;
+    std::vector<std::wstring> archiveQueue;
+    bool archiveStopping = false;
+
+    // 同一秒内的消息复用已格式化的时间戳
+    int64_t cachedSecond = -1;
+    std::string cachedStamp;
+};
@@ -0,0 +1,46 @@
+#include "logview.h"
+
+LogViewModel::LogViewModel(size_t capacity) : ring(capacity > 0 ? capacity : 1) {}
+
+bool LogViewModel::post(std::wstring line) {
+    std::lock_guard<std::mutex> lk(pendingMtx);
+    pending.push_back(std::move(line));
+    return pending.size() == 1;
+}
+
+size_t LogViewModel::commit(size_t* evicted) {
+    {
+        std::lock_guard<std::mutex> lk(pendingMtx);
+        incoming.swap(pending);
+    }
+
+    size_t dropped = 0;
+    const size_t cap = ring.size();
+
+    // 一批超过容量时，前面那些行并入后马上就会被挤掉，直接跳过
+    size_t first = incoming.size() > cap ? incoming.size() - cap : 0;
+    for (size_t i = first; i < incoming.size(); ++i) {
+        if (count < cap) {
+            ring[(head + count) % cap].swap(incoming[i]);
+            ++count;
+        } else {
+            ring[head].swap(incoming[i]);  // 覆盖最旧的一行
+            head = (head + 1) % cap;
+            ++dropped;
+        }
+    }
+
+    size_t added = incoming.size();
+    dropped += first;
+    total += added;
+    incoming.clear();
+
+    if (evicted) *evicted = dropped;
+    return added;
+}
+
+void LogViewModel::clear() {
+    for (auto& s : ring) s.clear();
+    head = 0;
+    count = 0;
+}
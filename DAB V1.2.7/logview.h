@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <cstddef>
+#include <cstdint>
+
+// 日志窗口的数据模型：固定容量的环形缓冲，写满后挤掉最旧的行，内存占用不随运行时间增长。
+// 不依赖任何窗口 API，界面只按行号取文本（虚拟列表），也可以单独做基准测试。
+// post() 可在任意线程调用，只把行放进待处理队列；commit() 由界面线程调用，成批并入缓冲。
+// 界面只在队列由空变为非空时才需要安排一次刷新，没有新日志时不必定时轮询。
+class LogViewModel {
+public:
+    explicit LogViewModel(size_t capacity = 5000);
+
+    // 返回待处理队列是否由空变为非空，此时调用者应通知界面线程安排一次 commit()
+    bool post(std::wstring line);
+
+    // 并入待处理的行，返回本次新增的行数；被挤出的旧行数通过 evicted 返回
+    size_t commit(size_t* evicted = nullptr);
+
+    size_t size() const { return count; }
+    size_t capacity() const { return ring.size(); }
+    uint64_t totalLines() const { return total; }
+
+    // 0 为缓冲中最旧的一行
+    const std::wstring& line(size_t index) const { return ring[(head + index) % ring.size()]; }
+
+    void clear();
+
+private:
+    std::vector<std::wstring> ring;
+    size_t head = 0;    // 最旧一行所在的位置
+    size_t count = 0;
+    uint64_t total = 0; // 累计并入过的行数
+
+    std::mutex pendingMtx;
+    std::vector<std::wstring> pending;
+    std::vector<std::wstring> incoming;  // commit() 复用的交换缓冲，避免反复分配
+};
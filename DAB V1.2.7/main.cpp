@@ -1,6 +1,51 @@
 #include <windows.h>
+#include <shellapi.h>
+#include <string>
+#include <cwchar>
 #include "gui.h"
+#include "daemon.h"
+#include "config.h"
 
+// 命令行：
+//   backup.exe                                        界面
+//   backup.exe --daemon [--config 路径] [--pipe 名称]   无界面运行，通过命名管道接受控制命令
+//   backup.exe --daemon --jobs 路径 [--pipe 名称]       无界面运行作业文件中的多个作业
+//   backup.exe --ctl 命令 [参数] [--pipe 名称]           向守护进程发送命令（start/stop/backup-now [作业名]/cancel/status/metrics/trace/reload/quit），
+//                                                     命令后面到下一个 "--" 选项为止的部分原样拼成一行发送
 int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, PWSTR, int nCmdShow) {
+    int argc = 0;
+    LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+
+    bool daemon = false;
+    std::wstring command;
+    std::wstring configPath;
+    std::wstring jobsPath;
+    std::wstring pipeName = DAEMON_PIPE_NAME;
+    for (int i = 1; argv && i < argc; ++i) {
+        std::wstring arg = argv[i];
+        if (arg == L"--daemon") daemon = true;
+        else if (arg == L"--ctl" && i + 1 < argc) {
+            // 参数不必加引号：backup.exe --ctl backup-now 项目A 发送的是 "backup-now 项目A"
+            command = argv[++i];
+            while (i + 1 < argc && wcsncmp(argv[i + 1], L"--", 2) != 0) {
+                command += L' ';
+                command += argv[++i];
+            }
+        }
+        else if (arg == L"--config" && i + 1 < argc) configPath = argv[++i];
+        else if (arg == L"--jobs" && i + 1 < argc) jobsPath = argv[++i];
+        else if (arg == L"--pipe" && i + 1 < argc) pipeName = argv[++i];
+    }
+    if (pipeName.find(L"\\\\.\\pipe\\") != 0) {
+        pipeName = L"\\\\.\\pipe\\" + pipeName;  // 允许只写管道名
+    }
+    if (argv) LocalFree(argv);
+
+    if (!command.empty()) {
+        return RunControlClient(pipeName, command);
+    }
+    if (daemon) {
+        return RunDaemon(configPath.empty() ? DefaultConfigPath() : configPath, jobsPath, pipeName);
+    }
     return RunBackupApp(hInstance, nCmdShow);
 }
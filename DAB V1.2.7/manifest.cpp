@@ -0,0 +1,136 @@
+#include "manifest.h"
+#include "copyengine.h"
+#include <windows.h>
+#include <vector>
+#include <cstring>
+
+namespace {
+
+const uint32_t MANIFEST_MAGIC = 0x4D424144;  // "DABM"
+const uint32_t MANIFEST_VERSION = 1;
+
+#pragma pack(push, 1)
+struct ManifestHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t count;
+};
+
+struct ManifestRecord {
+    uint32_t pathLength;  // 路径的 wchar_t 个数，路径紧跟在记录后面
+    uint64_t size;
+    int64_t srcWriteTime;
+    uint64_t hash;
+};
+#pragma pack(pop)
+
+} // namespace
+
+bool BackupManifest::load(const std::wstring& path) {
+    entries.clear();
+    modified = false;
+
+    HANDLE hFile = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                               OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(hFile, &fileSize) || fileSize.QuadPart < (LONGLONG)sizeof(ManifestHeader) ||
+        fileSize.QuadPart > 0x7FFFFFFF) {
+        CloseHandle(hFile);
+        return false;
+    }
+
+    std::vector<char> data((size_t)fileSize.QuadPart);
+    DWORD bytesRead = 0;
+    BOOL readOk = ReadFile(hFile, data.data(), (DWORD)data.size(), &bytesRead, NULL);
+    CloseHandle(hFile);
+    if (!readOk || bytesRead != data.size()) return false;
+
+    ManifestHeader header;
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (header.magic != MANIFEST_MAGIC || header.version != MANIFEST_VERSION) return false;
+
+    size_t pos = sizeof(header);
+    entries.reserve((size_t)header.count);
+    for (uint64_t i = 0; i < header.count; ++i) {
+        ManifestRecord rec;
+        if (pos + sizeof(rec) > data.size()) break;
+        std::memcpy(&rec, data.data() + pos, sizeof(rec));
+        pos += sizeof(rec);
+
+        size_t pathBytes = (size_t)rec.pathLength * sizeof(wchar_t);
+        if (pos + pathBytes > data.size()) break;
+        std::wstring relPath(rec.pathLength, L'\0');
+        std::memcpy(&relPath[0], data.data() + pos, pathBytes);
+        pos += pathBytes;
+
+        Slot& slot = entries.try_emplace(std::move(relPath)).first->second;
+        slot.entry.size = rec.size;
+        slot.entry.srcWriteTime = rec.srcWriteTime;
+        slot.entry.hash = rec.hash;
+    }
+
+    // 截断的清单不可信，当作没有清单处理
+    if (entries.size() != header.count) {
+        entries.clear();
+        return false;
+    }
+    return true;
+}
+
+bool BackupManifest::save(const std::wstring& path, bool pruneUnseen) {
+    std::vector<char> data(sizeof(ManifestHeader));
+    uint64_t count = 0;
+
+    for (const auto& kv : entries) {
+        if (pruneUnseen && !kv.second.seen) continue;
+
+        ManifestRecord rec;
+        rec.pathLength = (uint32_t)kv.first.size();
+        rec.size = kv.second.entry.size;
+        rec.srcWriteTime = kv.second.entry.srcWriteTime;
+        rec.hash = kv.second.entry.hash;
+
+        size_t pos = data.size();
+        size_t pathBytes = kv.first.size() * sizeof(wchar_t);
+        data.resize(pos + sizeof(rec) + pathBytes);
+        std::memcpy(data.data() + pos, &rec, sizeof(rec));
+        std::memcpy(data.data() + pos + sizeof(rec), kv.first.data(), pathBytes);
+        ++count;
+    }
+
+    ManifestHeader header = { MANIFEST_MAGIC, MANIFEST_VERSION, count };
+    std::memcpy(data.data(), &header, sizeof(header));
+
+    const std::wstring tmp = path + TEMP_FILE_SUFFIX;
+    HANDLE hFile = CreateFileW(tmp.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                               FILE_ATTRIBUTE_HIDDEN, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) return false;
+
+    DWORD written = 0;
+    bool ok = WriteFile(hFile, data.data(), (DWORD)data.size(), &written, NULL) && written == data.size() &&
+              FlushFileBuffers(hFile);
+    CloseHandle(hFile);
+
+    if (!ok || !MoveFileExW(tmp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+        DeleteFileW(tmp.c_str());
+        return false;
+    }
+    modified = false;
+    return true;
+}
+
+const ManifestEntry* BackupManifest::find(const std::wstring& relPath) {
+    auto it = entries.find(relPath);
+    if (it == entries.end()) return nullptr;
+    it->second.seen = true;
+    return &it->second.entry;
+}
+
+void BackupManifest::update(const std::wstring& relPath, const ManifestEntry& entry) {
+    Slot& slot = entries[relPath];
+    slot.entry = entry;
+    slot.seen = true;
+    modified = true;
+}
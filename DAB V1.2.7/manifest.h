@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <unordered_map>
+
+// 备份清单文件名（位于每个目标的 "xxx Backup" 文件夹内）
+const wchar_t MANIFEST_FILE_NAME[] = L".dabmanifest";
+
+// 清单中记录的一个文件：最后一次写入目标时源文件的状态
+struct ManifestEntry {
+    unsigned long long size = 0;
+    long long srcWriteTime = 0;  // 源文件修改时间（file_time_type 的计数值）
+    uint64_t hash = 0;           // 写入内容的 FNV-1a 哈希，0 表示未知
+};
+
+// 每个目标一份的增量备份清单。增量模式只拿源文件与内存中的清单比较，
+// 不再对目标盘上的文件做 exists / last_write_time / file_size，
+// 同时也避开了 FAT 盘 2 秒修改时间精度导致的重复拷贝。
+class BackupManifest {
+public:
+    // 读取清单，文件不存在或已损坏时返回 false 且清单为空
+    bool load(const std::wstring& path);
+
+    // 写入临时文件后改名。pruneUnseen 为 true 时未访问过的条目（源文件已删除）不再保存，
+    // 只能在完整遍历过源路径之后使用；遍历中途取消或出错时传 false，未走到的条目原样保留
+    bool save(const std::wstring& path, bool pruneUnseen);
+
+    const ManifestEntry* find(const std::wstring& relPath);
+    void update(const std::wstring& relPath, const ManifestEntry& entry);
+
+    bool dirty() const { return modified; }
+    size_t size() const { return entries.size(); }
+
+private:
+    struct Slot {
+        ManifestEntry entry;
+        bool seen = false;
+    };
+
+    std::unordered_map<std::wstring, Slot> entries;
+    bool modified = false;
+};
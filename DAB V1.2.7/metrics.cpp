@@ -0,0 +1,299 @@
+#include "metrics.h"
+#include <windows.h>
+#include <chrono>
+#include <cstdio>
+
+uint64_t MetricsNowMicros() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int MetricHistogram::BucketIndex(uint64_t value) {
+    if (value < (uint64_t)SUB_BUCKETS) return (int)value;
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - SUB_BUCKET_BITS;
+    // value >> shift 落在 [16, 32)，减去 16 即区间内的格子
+    return SUB_BUCKETS + shift * SUB_BUCKETS + (int)((value >> shift) - SUB_BUCKETS);
+}
+
+uint64_t MetricHistogram::BucketUpper(int index) {
+    if (index < SUB_BUCKETS) return (uint64_t)index;
+    int shift = (index - SUB_BUCKETS) / SUB_BUCKETS;
+    uint64_t sub = (uint64_t)((index - SUB_BUCKETS) % SUB_BUCKETS);
+    uint64_t lower = (SUB_BUCKETS + sub) << shift;
+    return lower + ((1ULL << shift) - 1);
+}
+
+void MetricHistogram::record(uint64_t value) {
+    buckets[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    sumValue.fetch_add(value, std::memory_order_relaxed);
+
+    uint64_t seen = maxValue.load(std::memory_order_relaxed);
+    while (value > seen && !maxValue.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {}
+}
+
+uint64_t MetricHistogram::valueAt(double quantile) const {
+    // 记录可能与读取同时进行，按桶里实际数到的总数计算，结果只会略有偏差
+    uint64_t counts[BUCKET_COUNT];
+    uint64_t n = 0;
+    for (int i = 0; i < BUCKET_COUNT; ++i) {
+        counts[i] = buckets[i].load(std::memory_order_relaxed);
+        n += counts[i];
+    }
+    if (n == 0) return 0;
+
+    if (quantile < 0) quantile = 0;
+    if (quantile > 1) quantile = 1;
+    uint64_t rank = (uint64_t)(quantile * (double)n + 0.5);
+    if (rank < 1) rank = 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKET_COUNT; ++i) {
+        seen += counts[i];
+        if (seen >= rank) {
+            uint64_t upper = BucketUpper(i);
+            uint64_t top = maximum();
+            return upper < top ? upper : top;
+        }
+    }
+    return maximum();
+}
+
+void MetricHistogram::reset() {
+    for (auto& b : buckets) b.store(0, std::memory_order_relaxed);
+    total.store(0, std::memory_order_relaxed);
+    sumValue.store(0, std::memory_order_relaxed);
+    maxValue.store(0, std::memory_order_relaxed);
+}
+
+TargetMetrics& BackupMetrics::target(const std::wstring& targetDir) {
+    std::lock_guard<std::mutex> lk(targetsMtx);
+    auto& slot = targets[targetDir];
+    if (!slot) slot = std::make_unique<TargetMetrics>();
+    return *slot;
+}
+
+namespace {
+
+std::string ToUtf8(const std::wstring& s) {
+    if (s.empty()) return std::string();
+    int len = WideCharToMultiByte(CP_UTF8, 0, s.data(), (int)s.size(), NULL, 0, NULL, NULL);
+    std::string out(len > 0 ? len : 0, '\0');
+    if (len > 0) WideCharToMultiByte(CP_UTF8, 0, s.data(), (int)s.size(), &out[0], len, NULL, NULL);
+    return out;
+}
+
+// Prometheus 标签值需要转义反斜杠、双引号和换行（Windows 路径里到处是反斜杠）
+std::string LabelValue(const std::wstring& s) {
+    std::string in = ToUtf8(s);
+    std::string out;
+    out.reserve(in.size() + 8);
+    for (char c : in) {
+        if (c == '\\') out += "\\\\";
+        else if (c == '"') out += "\\\"";
+        else if (c == '\n') out += "\\n";
+        else out += c;
+    }
+    return out;
+}
+
+void Header(std::string& out, const char* name, const char* type, const char* help) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+void Sample(std::string& out, const char* name, const std::string& labels, double value) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), " %.9g\n", value);
+    out += name;
+    if (!labels.empty()) {
+        out += '{';
+        out += labels;
+        out += '}';
+    }
+    out += buf;
+}
+
+// 直方图按 summary 类型输出分位数，scale 把内部单位换算成输出单位（例如微秒 -> 秒）
+void Quantiles(std::string& out, const char* name, const std::string& labels,
+               const MetricHistogram& h, double scale) {
+    static const char* const names[] = { "0.5", "0.9", "0.99", "0.999" };
+    static const double values[] = { 0.5, 0.9, 0.99, 0.999 };
+    std::string prefix = labels.empty() ? std::string() : labels + ",";
+    for (int i = 0; i < 4; ++i) {
+        Sample(out, name, prefix + "quantile=\"" + names[i] + "\"", h.valueAt(values[i]) * scale);
+    }
+    std::string base = name;
+    Sample(out, (base + "_sum").c_str(), labels, h.sum() * scale);
+    Sample(out, (base + "_count").c_str(), labels, (double)h.count());
+}
+
+} // namespace
+
+std::string BackupMetrics::toPrometheus() const {
+    return ToPrometheus({ { std::wstring(), this } });
+}
+
+namespace {
+
+typedef std::vector<std::pair<std::wstring, const BackupMetrics*>> MetricSets;
+
+std::string JobLabel(const std::wstring& job) {
+    return job.empty() ? std::string() : "job=\"" + LabelValue(job) + "\"";
+}
+
+std::string TargetLabel(const std::wstring& job, const std::wstring& target) {
+    std::string label = JobLabel(job);
+    return (label.empty() ? label : label + ",") + "target=\"" + LabelValue(target) + "\"";
+}
+
+void CounterFamily(std::string& out, const MetricSets& sets, const char* name, const char* help,
+                   const MetricCounter BackupMetrics::*member) {
+    Header(out, name, "counter", help);
+    for (const auto& s : sets) {
+        Sample(out, name, JobLabel(s.first), (double)(s.second->*member).get());
+    }
+}
+
+void SummaryFamily(std::string& out, const MetricSets& sets, const char* name, const char* help,
+                   const MetricHistogram BackupMetrics::*member) {
+    Header(out, name, "summary", help);
+    for (const auto& s : sets) {
+        Quantiles(out, name, JobLabel(s.first), s.second->*member, 1e-6);
+    }
+}
+
+} // namespace
+
+std::string BackupMetrics::ToPrometheus(const std::vector<std::pair<std::wstring, const BackupMetrics*>>& sets) {
+    // 同一个指标的所有样本（各作业、各目标）必须连在一起，只出现一次 HELP / TYPE
+    std::string out;
+    CounterFamily(out, sets, "dab_events_received_total", "Directory change notifications received.", &BackupMetrics::eventsReceived);
+    CounterFamily(out, sets, "dab_poll_scans_total", "Source scans performed in polling mode.", &BackupMetrics::pollScans);
+    CounterFamily(out, sets, "dab_changes_detected_total", "Changes to the source that triggered a backup.", &BackupMetrics::changesDetected);
+    CounterFamily(out, sets, "dab_backups_triggered_total", "Backup runs started (automatic and manual).", &BackupMetrics::backupsTriggered);
+    CounterFamily(out, sets, "dab_files_scanned_total", "Source files examined.", &BackupMetrics::filesScanned);
+    CounterFamily(out, sets, "dab_files_copied_total", "Files copied to a target.", &BackupMetrics::filesCopied);
+    CounterFamily(out, sets, "dab_files_skipped_total", "Files skipped because they were unchanged.", &BackupMetrics::filesSkipped);
+    CounterFamily(out, sets, "dab_files_failed_total", "Files that failed to copy.", &BackupMetrics::filesFailed);
+    CounterFamily(out, sets, "dab_bytes_copied_total", "Bytes written to targets.", &BackupMetrics::bytesCopied);
+    CounterFamily(out, sets, "dab_backups_cancelled_total", "Backup runs cancelled before completion.", &BackupMetrics::backupsCancelled);
+    CounterFamily(out, sets, "dab_backups_deferred_total", "Backup runs deferred because the system was under load.", &BackupMetrics::backupsDeferred);
+    SummaryFamily(out, sets, "dab_change_to_backup_seconds", "Latency from change detection to backup completion.", &BackupMetrics::changeToBackup);
+    SummaryFamily(out, sets, "dab_change_to_commit_seconds", "Latency from change detection to data committed on a target.", &BackupMetrics::changeToCommit);
+    SummaryFamily(out, sets, "dab_run_duration_seconds", "Duration of one backup run on one target.", &BackupMetrics::runDuration);
+    SummaryFamily(out, sets, "dab_stop_latency_seconds", "Time from a stop request until the watch thread exited.", &BackupMetrics::stopLatency);
+    SummaryFamily(out, sets, "dab_defer_duration_seconds", "Time a deferred backup waited for system load to drop.", &BackupMetrics::deferDuration);
+
+    // 各目标的指标：先在锁内取出 (作业, 目标, 指标) 列表，目标对象创建后地址不变
+    struct TargetRef {
+        std::wstring job;
+        std::wstring target;
+        const TargetMetrics* metrics;
+    };
+    std::vector<TargetRef> refs;
+    for (const auto& s : sets) {
+        std::lock_guard<std::mutex> lk(s.second->targetsMtx);
+        for (const auto& kv : s.second->targets) {
+            refs.push_back({ s.first, kv.first, kv.second.get() });
+        }
+    }
+    if (refs.empty()) return out;
+
+    Header(out, "dab_target_runs_total", "counter", "Backup runs per target.");
+    for (const auto& r : refs) {
+        Sample(out, "dab_target_runs_total", TargetLabel(r.job, r.target), (double)r.metrics->runs.get());
+    }
+    Header(out, "dab_target_failed_runs_total", "counter", "Backup runs with at least one failed file per target.");
+    for (const auto& r : refs) {
+        Sample(out, "dab_target_failed_runs_total", TargetLabel(r.job, r.target), (double)r.metrics->failedRuns.get());
+    }
+    Header(out, "dab_target_files_copied_total", "counter", "Files copied per target.");
+    for (const auto& r : refs) {
+        Sample(out, "dab_target_files_copied_total", TargetLabel(r.job, r.target), (double)r.metrics->files.get());
+    }
+    Header(out, "dab_target_bytes_copied_total", "counter", "Bytes written per target.");
+    for (const auto& r : refs) {
+        Sample(out, "dab_target_bytes_copied_total", TargetLabel(r.job, r.target), (double)r.metrics->bytes.get());
+    }
+    Header(out, "dab_target_busy_seconds_total", "counter", "Time spent backing up per target.");
+    for (const auto& r : refs) {
+        Sample(out, "dab_target_busy_seconds_total", TargetLabel(r.job, r.target), r.metrics->busyMicros.get() * 1e-6);
+    }
+    Header(out, "dab_target_throughput_bytes_per_second", "summary", "Write throughput of backup runs per target.");
+    for (const auto& r : refs) {
+        Quantiles(out, "dab_target_throughput_bytes_per_second", TargetLabel(r.job, r.target), r.metrics->throughput, 1.0);
+    }
+    Header(out, "dab_target_change_to_commit_seconds", "summary", "Latency from change detection to data committed per target.");
+    for (const auto& r : refs) {
+        Quantiles(out, "dab_target_change_to_commit_seconds", TargetLabel(r.job, r.target), r.metrics->changeToCommit, 1e-6);
+    }
+    return out;
+}
+
+std::wstring BackupMetrics::summary() const {
+    wchar_t buf[512];
+    swprintf(buf, 512,
+             L"目录事件: %llu    轮询扫描: %llu\r\n"
+             L"检测到变化: %llu    执行备份: %llu\r\n"
+             L"文件: 检查 %llu，拷贝 %llu，跳过 %llu，失败 %llu\r\n"
+             L"写入: %.1f MB\r\n"
+             L"变化到备份完成: p50 %.1f ms，p99 %.1f ms，最长 %.1f ms（%llu 次）\r\n"
+             L"变化到目标落盘: p50 %.1f ms，p99 %.1f ms，最长 %.1f ms（%llu 次）\r\n"
+             L"停止监听耗时: 最长 %.1f ms（%llu 次），取消的备份: %llu\r\n"
+             L"因负载推迟: %llu 次，最长 %.1f s\r\n",
+             (unsigned long long)eventsReceived.get(), (unsigned long long)pollScans.get(),
+             (unsigned long long)changesDetected.get(), (unsigned long long)backupsTriggered.get(),
+             (unsigned long long)filesScanned.get(), (unsigned long long)filesCopied.get(),
+             (unsigned long long)filesSkipped.get(), (unsigned long long)filesFailed.get(),
+             bytesCopied.get() / (1024.0 * 1024.0),
+             changeToBackup.valueAt(0.5) / 1000.0, changeToBackup.valueAt(0.99) / 1000.0,
+             changeToBackup.maximum() / 1000.0, (unsigned long long)changeToBackup.count(),
+             changeToCommit.valueAt(0.5) / 1000.0, changeToCommit.valueAt(0.99) / 1000.0,
+             changeToCommit.maximum() / 1000.0, (unsigned long long)changeToCommit.count(),
+             stopLatency.maximum() / 1000.0, (unsigned long long)stopLatency.count(),
+             (unsigned long long)backupsCancelled.get(),
+             (unsigned long long)backupsDeferred.get(), deferDuration.maximum() / 1e6);
+    std::wstring text = buf;
+
+    std::lock_guard<std::mutex> lk(targetsMtx);
+    for (const auto& kv : targets) {
+        const TargetMetrics& t = *kv.second;
+        double seconds = t.busyMicros.get() * 1e-6;
+        swprintf(buf, 512, L"\r\n%ls\r\n  备份 %llu 次（失败 %llu），拷贝 %llu 个文件，%.1f MB，平均 %.1f MB/s，p50 %.1f MB/s\r\n"
+                           L"  变化到落盘: p50 %.1f ms，p99 %.1f ms\r\n",
+                 kv.first.c_str(), (unsigned long long)t.runs.get(), (unsigned long long)t.failedRuns.get(),
+                 (unsigned long long)t.files.get(), t.bytes.get() / (1024.0 * 1024.0),
+                 seconds > 0 ? t.bytes.get() / (1024.0 * 1024.0) / seconds : 0.0,
+                 t.throughput.valueAt(0.5) / (1024.0 * 1024.0),
+                 t.changeToCommit.valueAt(0.5) / 1000.0, t.changeToCommit.valueAt(0.99) / 1000.0);
+        text += buf;
+    }
+    return text;
+}
+
+bool BackupMetrics::writeFile(const std::wstring& path) const {
+    std::string text = toPrometheus();
+
+    const std::wstring tmp = path + L".tmp";
+    HANDLE hFile = CreateFileW(tmp.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) return false;
+
+    DWORD written = 0;
+    bool ok = WriteFile(hFile, text.data(), (DWORD)text.size(), &written, NULL) && written == text.size();
+    CloseHandle(hFile);
+
+    if (!ok || !MoveFileExW(tmp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+        DeleteFileW(tmp.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <vector>
+#include <utility>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+// 运行指标：原子计数器和对数-线性直方图，备份线程只做原子加法，不加锁。
+// 界面可以随时读取汇总文本，也可以按 Prometheus 文本格式写入文件供监控采集。
+
+// 默认的指标文件名（位于程序目录）
+const wchar_t METRICS_FILE_NAME[] = L"metrics.prom";
+
+class MetricCounter {
+public:
+    void add(uint64_t n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> value{ 0 };
+};
+
+// HDR 风格的直方图：每个 2 的幂区间再均分成 16 格，相对误差不超过 1/16，
+// 取值范围覆盖整个 uint64，桶数固定（976 个），记录一次只是几次原子加法。
+class MetricHistogram {
+public:
+    static const int SUB_BUCKET_BITS = 4;
+    static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static const int BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    void record(uint64_t value);
+
+    uint64_t count() const { return total.load(std::memory_order_relaxed); }
+    uint64_t sum() const { return sumValue.load(std::memory_order_relaxed); }
+    uint64_t maximum() const { return maxValue.load(std::memory_order_relaxed); }
+
+    // quantile 取 0~1，返回所在桶的上界（偏保守）；没有记录时返回 0
+    uint64_t valueAt(double quantile) const;
+
+    void reset();
+
+private:
+    static int BucketIndex(uint64_t value);
+    static uint64_t BucketUpper(int index);
+
+    std::atomic<uint64_t> buckets[BUCKET_COUNT] = {};
+    std::atomic<uint64_t> total{ 0 };
+    std::atomic<uint64_t> sumValue{ 0 };
+    std::atomic<uint64_t> maxValue{ 0 };
+};
+
+// 单个备份目标的指标
+struct TargetMetrics {
+    MetricCounter runs;
+    MetricCounter failedRuns;      // 有文件拷贝失败的备份次数
+    MetricCounter files;
+    MetricCounter bytes;
+    MetricCounter busyMicros;      // 累计备份耗时
+    MetricHistogram throughput;    // 每次备份的写入速度（字节/秒），只统计实际写入了数据的备份
+    MetricHistogram changeToCommit;  // 检测到变化到本目标数据落盘的延迟（微秒）
+};
+
+class BackupMetrics {
+public:
+    MetricCounter eventsReceived;    // 收到的目录变更通知（包括与源文件无关的）
+    MetricCounter pollScans;         // 轮询模式下扫描源路径的次数
+    MetricCounter changesDetected;   // 事件匹配或轮询发现了变化
+    MetricCounter backupsTriggered;  // 执行 backupFile() 的次数（自动和手动）
+    MetricCounter filesScanned;
+    MetricCounter filesCopied;
+    MetricCounter filesSkipped;
+    MetricCounter filesFailed;
+    MetricCounter bytesCopied;
+    MetricCounter backupsCancelled;  // 被取消（手动取消或停止监听）而提前结束的备份
+    MetricCounter backupsDeferred;   // 因系统负载高而推迟开始的备份
+    MetricHistogram changeToBackup;  // 检测到变化到备份完成的延迟（微秒）
+    MetricHistogram changeToCommit;  // 检测到变化到某个目标数据落盘的延迟（微秒），每个目标记一次
+    MetricHistogram runDuration;     // 单个目标一次备份的耗时（微秒）
+    MetricHistogram stopLatency;     // stopWatching() 从请求停止到监听线程退出的耗时（微秒）
+    MetricHistogram deferDuration;   // 推迟的备份等待负载下降的时间（微秒）
+
+    // 目标第一次出现时创建，之后返回同一个对象（对象地址不变，可以在锁外更新）
+    TargetMetrics& target(const std::wstring& targetDir);
+
+    std::string toPrometheus() const;
+
+    // 多个作业的指标写在一起，每个样本带 job 标签（名字为空的不加）
+    static std::string ToPrometheus(const std::vector<std::pair<std::wstring, const BackupMetrics*>>& sets);
+
+    // 界面上显示的简短汇总
+    std::wstring summary() const;
+
+    // 先写临时文件再改名，采集程序不会读到写了一半的文件
+    bool writeFile(const std::wstring& path) const;
+
+private:
+    mutable std::mutex targetsMtx;
+    std::map<std::wstring, std::unique_ptr<TargetMetrics>> targets;
+};
+
+// 单调时钟，微秒
+uint64_t MetricsNowMicros();
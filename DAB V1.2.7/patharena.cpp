@@ -0,0 +1,46 @@
+#include "patharena.h"
+#include <cstring>
+
+PathArena::PathArena(size_t blockChars)
+    : blockSize(blockChars > 0 ? blockChars : 1) {}
+
+const wchar_t* PathArena::store(std::wstring_view s) {
+    const size_t need = s.size() + 1;
+    if (blocks.empty() || capacity - offset < need) {
+        // 超过一块的长字符串单独占一块
+        size_t size = need > blockSize ? need : blockSize;
+        if (blocks.empty()) firstCapacity = size;
+        blocks.emplace_back(new wchar_t[size]);
+        capacity = size;
+        offset = 0;
+    }
+
+    wchar_t* out = blocks.back().get() + offset;
+    if (!s.empty()) std::memcpy(out, s.data(), s.size() * sizeof(wchar_t));
+    out[s.size()] = L'\0';
+    offset += need;
+    used += need;
+    return out;
+}
+
+void PathArena::reset() {
+    // 只保留第一块；它是超长字符串单独占的块时也不保留
+    if (blocks.size() > 1) blocks.resize(1);
+    if (firstCapacity != blockSize) blocks.clear();
+    capacity = blocks.empty() ? 0 : blockSize;
+    offset = 0;
+    used = 0;
+}
+
+std::wstring_view PathInterner::intern(std::wstring_view s, bool* inserted) {
+    auto found = entries.find(s);
+    if (found != entries.end()) {
+        if (inserted) *inserted = false;
+        return *found;
+    }
+
+    std::wstring_view stored(arena.store(s), s.size());
+    entries.insert(stored);
+    if (inserted) *inserted = true;
+    return stored;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <unordered_set>
+#include <cstddef>
+
+// 一次备份内使用的路径内存池：按块申请内存，字符串依次追加在块尾，不单独释放，
+// reset() 或析构时一次性归还（reset 保留第一块供下次复用）。
+// 存入的字符串以 L'\0' 结尾，reset 之前地址不变，可以直接交给 Win32 API。
+class PathArena {
+public:
+    explicit PathArena(size_t blockChars = 32 * 1024);
+
+    PathArena(const PathArena&) = delete;
+    PathArena& operator=(const PathArena&) = delete;
+
+    const wchar_t* store(std::wstring_view s);
+    void reset();
+
+    size_t blockCount() const { return blocks.size(); }
+    size_t usedChars() const { return used; }
+
+private:
+    size_t blockSize;
+    std::vector<std::unique_ptr<wchar_t[]>> blocks;
+    size_t offset = 0;         // 最后一块中已用的字符数
+    size_t capacity = 0;       // 最后一块的字符数
+    size_t firstCapacity = 0;  // 第一块的字符数
+    size_t used = 0;
+};
+
+// 目录前缀的驻留表：同一个目录在池中只存一份，重复出现时只做一次查找。
+// 例如增量备份中记录已经建好的目标目录，同一目录下的文件不再各自检查、创建上级目录。
+class PathInterner {
+public:
+    explicit PathInterner(PathArena& pool) : arena(pool) {}
+
+    // 返回池中与 s 内容相同的那一份，第一次出现时存入；inserted 表示这次是否新存入
+    std::wstring_view intern(std::wstring_view s, bool* inserted = nullptr);
+    bool contains(std::wstring_view s) const { return entries.count(s) != 0; }
+    size_t size() const { return entries.size(); }
+
+private:
+    PathArena& arena;
+    std::unordered_set<std::wstring_view> entries;
+};
+
+// 遍历目录树时复用的路径缓冲：进入下一级时追加 "\名字"，返回时截回原长度，
+// 整个遍历只在路径比以往都长时才重新分配。
+class PathBuffer {
+public:
+    explicit PathBuffer(size_t reserveChars = 512) { path.reserve(reserveChars); }
+
+    void assign(std::wstring_view s) { path.assign(s.data(), s.size()); }
+
+    // 追加一级，返回追加前的长度，用于 truncate
+    size_t push(std::wstring_view name) {
+        size_t len = path.size();
+        if (!path.empty() && path.back() != L'\\' && path.back() != L'/') path += L'\\';
+        path.append(name.data(), name.size());
+        return len;
+    }
+    void truncate(size_t len) { path.resize(len); }
+
+    const std::wstring& str() const { return path; }
+    const wchar_t* c_str() const { return path.c_str(); }
+    size_t size() const { return path.size(); }
+
+private:
+    std::wstring path;
+};
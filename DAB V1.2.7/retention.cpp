@@ -0,0 +1,490 @@
+#include "retention.h"
+#include "copyengine.h"
+#include "trace.h"
+#include <windows.h>
+#include <algorithm>
+#include <ctime>
+#include <cwchar>
+#include <cstring>
+#include <map>
+
+namespace {
+
+const uint32_t INDEX_MAGIC = 0x49424144;  // "DABI"
+const uint32_t INDEX_VERSION = 1;
+
+#pragma pack(push, 1)
+struct IndexHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t count;
+};
+
+struct IndexRecord {
+    uint32_t nameLength;  // 名字的 wchar_t 个数，名字紧跟在记录后面
+    int64_t time;
+    uint64_t bytes;
+};
+#pragma pack(pop)
+
+struct IndexedVersion {
+    long long time;
+    unsigned long long bytes;
+};
+
+// 读取 .dabindex，文件不存在或损坏时返回空表
+std::map<std::wstring, IndexedVersion> ReadIndexFile(const std::wstring& path) {
+    std::map<std::wstring, IndexedVersion> result;
+
+    HANDLE hFile = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                               OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) return result;
+
+    LARGE_INTEGER fileSize;
+    std::vector<char> data;
+    bool ok = GetFileSizeEx(hFile, &fileSize) && fileSize.QuadPart >= (LONGLONG)sizeof(IndexHeader) &&
+              fileSize.QuadPart < 0x7FFFFFFF;
+    if (ok) {
+        data.resize((size_t)fileSize.QuadPart);
+        DWORD bytesRead = 0;
+        ok = ReadFile(hFile, data.data(), (DWORD)data.size(), &bytesRead, NULL) && bytesRead == data.size();
+    }
+    CloseHandle(hFile);
+    if (!ok) return result;
+
+    IndexHeader header;
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (header.magic != INDEX_MAGIC || header.version != INDEX_VERSION) return result;
+
+    size_t pos = sizeof(header);
+    for (uint64_t i = 0; i < header.count; ++i) {
+        IndexRecord rec;
+        if (pos + sizeof(rec) > data.size()) break;
+        std::memcpy(&rec, data.data() + pos, sizeof(rec));
+        pos += sizeof(rec);
+
+        size_t nameBytes = (size_t)rec.nameLength * sizeof(wchar_t);
+        if (pos + nameBytes > data.size()) break;
+        std::wstring name(rec.nameLength, L'\0');
+        std::memcpy(&name[0], data.data() + pos, nameBytes);
+        pos += nameBytes;
+
+        result[name] = { rec.time, rec.bytes };
+    }
+    return result;
+}
+
+long long FileTimeToTimeT(const FILETIME& ft) {
+    unsigned long long ticks = ((unsigned long long)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+    return (long long)((ticks - 116444736000000000ULL) / 10000000ULL);
+}
+
+// 从 "name_20250820_153000" 末尾解析备份时间，解析失败返回 false
+bool ParseStemTime(const std::wstring& stem, long long& out) {
+    if (stem.size() < 16) return false;
+
+    const std::wstring ts = stem.substr(stem.size() - 15);  // YYYYMMDD_HHMMSS
+    if (ts[8] != L'_' || stem[stem.size() - 16] != L'_') return false;
+
+    std::tm t = {};
+    if (swscanf(ts.c_str(), L"%4d%2d%2d_%2d%2d%2d",
+                &t.tm_year, &t.tm_mon, &t.tm_mday, &t.tm_hour, &t.tm_min, &t.tm_sec) != 6) {
+        return false;
+    }
+    t.tm_year -= 1900;
+    t.tm_mon -= 1;
+    t.tm_isdst = -1;
+    std::time_t value = std::mktime(&t);
+    if (value == (std::time_t)-1) return false;
+    out = (long long)value;
+    return true;
+}
+
+// 文件夹备份名为 "name_时间戳"，文件备份名为 "name_时间戳.ext"
+bool ParseBackupTime(const std::wstring& name, long long& out) {
+    if (ParseStemTime(name, out)) return true;
+    size_t dot = name.find_last_of(L'.');
+    return dot != std::wstring::npos && ParseStemTime(name.substr(0, dot), out);
+}
+
+// 本地日期距 1970-01-01 的天数
+long long LocalDayIndex(long long t) {
+    std::time_t tt = (std::time_t)t;
+    std::tm local{};
+    localtime_s(&local, &tt);
+
+    int y = local.tm_year + 1900;
+    int m = local.tm_mon + 1;
+    int d = local.tm_mday;
+    y -= m <= 2;
+    long long era = (y >= 0 ? y : y - 399) / 400;
+    long long yoe = y - era * 400;
+    long long doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    long long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+// 第 tier 级的时间桶（按本地时间划分，小时桶嵌套在天桶内，天桶嵌套在周桶内）
+long long BucketOf(long long t, int tier) {
+    long long day = LocalDayIndex(t);
+    switch (tier) {
+        case 1: {
+            std::time_t tt = (std::time_t)t;
+            std::tm local{};
+            localtime_s(&local, &tt);
+            return day * 24 + local.tm_hour;
+        }
+        case 2:
+            return day;
+        default:
+            return (day + 3) / 7;  // 1970-01-01 是星期四，+3 使每周从星期一开始
+    }
+}
+
+bool IsDotEntry(const wchar_t* name) {
+    return name[0] == L'.';
+}
+
+// 删除 path 指向的文件或整个目录树。复用同一个路径缓冲区逐层追加/截断文件名，
+// 每个目录只枚举一次（FIND_FIRST_EX_LARGE_FETCH），按名字直接删除，不再逐项查询属性。
+bool DeleteTree(std::wstring& path, DWORD attr) {
+    if (attr & FILE_ATTRIBUTE_READONLY) {
+        SetFileAttributesW(path.c_str(), attr & ~FILE_ATTRIBUTE_READONLY);
+    }
+    if (!(attr & FILE_ATTRIBUTE_DIRECTORY)) {
+        return DeleteFileW(path.c_str()) != 0;
+    }
+    if (attr & FILE_ATTRIBUTE_REPARSE_POINT) {
+        return RemoveDirectoryW(path.c_str()) != 0;  // 只删链接本身，不进入链接目标
+    }
+
+    bool ok = true;
+    const size_t baseLen = path.size();
+    path += L"\\*";
+
+    WIN32_FIND_DATAW ffd;
+    HANDLE hFind = FindFirstFileExW(path.c_str(), FindExInfoBasic, &ffd, FindExSearchNameMatch,
+                                    NULL, FIND_FIRST_EX_LARGE_FETCH);
+    path.resize(baseLen);
+    if (hFind != INVALID_HANDLE_VALUE) {
+        do {
+            if (wcscmp(ffd.cFileName, L".") == 0 || wcscmp(ffd.cFileName, L"..") == 0) continue;
+            path += L'\\';
+            path += ffd.cFileName;
+            if (!DeleteTree(path, ffd.dwFileAttributes)) ok = false;
+            path.resize(baseLen);
+        } while (FindNextFileW(hFind, &ffd));
+        FindClose(hFind);
+    }
+
+    if (!RemoveDirectoryW(path.c_str())) ok = false;
+    return ok;
+}
+
+// 统计一个目录项的字节数，目录则递归累加（path 作为可复用的缓冲区，返回时恢复原值）
+unsigned long long MeasureTree(std::wstring& path, const WIN32_FIND_DATAW& info) {
+    if (!(info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+        return ((unsigned long long)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+    }
+    if (info.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) return 0;
+
+    unsigned long long bytes = 0;
+    const size_t baseLen = path.size();
+    path += L"\\*";
+
+    WIN32_FIND_DATAW ffd;
+    HANDLE hFind = FindFirstFileExW(path.c_str(), FindExInfoBasic, &ffd, FindExSearchNameMatch,
+                                    NULL, FIND_FIRST_EX_LARGE_FETCH);
+    path.resize(baseLen);
+    if (hFind == INVALID_HANDLE_VALUE) return 0;
+
+    do {
+        if (wcscmp(ffd.cFileName, L".") == 0 || wcscmp(ffd.cFileName, L"..") == 0) continue;
+        path += L'\\';
+        path += ffd.cFileName;
+        bytes += MeasureTree(path, ffd);
+        path.resize(baseLen);
+    } while (FindNextFileW(hFind, &ffd));
+    FindClose(hFind);
+    return bytes;
+}
+
+} // namespace
+
+unsigned long long MeasurePathSize(const std::wstring& path) {
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &data)) return 0;
+
+    WIN32_FIND_DATAW info = {};
+    info.dwFileAttributes = data.dwFileAttributes;
+    info.nFileSizeHigh = data.nFileSizeHigh;
+    info.nFileSizeLow = data.nFileSizeLow;
+
+    std::wstring buffer = path;
+    return MeasureTree(buffer, info);
+}
+
+void RetentionIndex::load(const std::wstring& folder, std::vector<std::wstring>* leftovers) {
+    versions.clear();
+    total = 0;
+    folderPath = folder;
+    isLoaded = true;
+    modified = false;
+
+    const auto indexed = ReadIndexFile(folder + L"\\" + RETENTION_INDEX_FILE_NAME);
+
+    WIN32_FIND_DATAW ffd;
+    std::wstring searchPath = folder + L"\\*";
+    HANDLE hFind = FindFirstFileExW(searchPath.c_str(), FindExInfoBasic, &ffd, FindExSearchNameMatch,
+                                    NULL, FIND_FIRST_EX_LARGE_FETCH);
+    if (hFind == INVALID_HANDLE_VALUE) return;
+
+    const size_t suffixLen = wcslen(TEMP_FILE_SUFFIX);
+    do {
+        if (IsDotEntry(ffd.cFileName)) continue;  // "."、".." 以及 .dabpartial 等内部文件
+
+        // 中断的拷贝留下的临时文件：不当作版本，也不计入配额
+        size_t nameLen = wcslen(ffd.cFileName);
+        if (nameLen > suffixLen && _wcsicmp(ffd.cFileName + nameLen - suffixLen, TEMP_FILE_SUFFIX) == 0) {
+            if (leftovers) leftovers->push_back(folder + L"\\" + ffd.cFileName);
+            continue;
+        }
+
+        BackupVersion v;
+        v.name = ffd.cFileName;
+        v.isDirectory = (ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+
+        auto known = indexed.find(v.name);
+        if (known != indexed.end()) {
+            v.time = known->second.time;
+            v.bytes = known->second.bytes;
+        } else {
+            // 索引文件里没有的版本（旧版本程序留下的或索引丢失）才需要遍历统计
+            if (!ParseBackupTime(v.name, v.time)) {
+                v.time = FileTimeToTimeT(ffd.ftLastWriteTime);
+            }
+            std::wstring path = folder + L"\\" + v.name;
+            v.bytes = MeasureTree(path, ffd);
+            modified = true;
+        }
+        total += v.bytes;
+        versions.push_back(v);
+    } while (FindNextFileW(hFind, &ffd));
+    FindClose(hFind);
+
+    if (versions.size() != indexed.size()) modified = true;
+    versions.sort([](const BackupVersion& a, const BackupVersion& b) { return a.time < b.time; });
+    resetTiers();
+}
+
+bool RetentionIndex::save() {
+    if (!modified || folderPath.empty()) return true;
+
+    std::vector<char> data(sizeof(IndexHeader));
+    for (const auto& v : versions) {
+        IndexRecord rec;
+        rec.nameLength = (uint32_t)v.name.size();
+        rec.time = v.time;
+        rec.bytes = v.bytes;
+
+        size_t pos = data.size();
+        size_t nameBytes = v.name.size() * sizeof(wchar_t);
+        data.resize(pos + sizeof(rec) + nameBytes);
+        std::memcpy(data.data() + pos, &rec, sizeof(rec));
+        std::memcpy(data.data() + pos + sizeof(rec), v.name.data(), nameBytes);
+    }
+    IndexHeader header = { INDEX_MAGIC, INDEX_VERSION, (uint64_t)versions.size() };
+    std::memcpy(data.data(), &header, sizeof(header));
+
+    // 同清单文件一样先写临时文件再改名，避免中断时留下不完整的索引
+    const std::wstring path = folderPath + L"\\" + RETENTION_INDEX_FILE_NAME;
+    const std::wstring tmp = path + L".tmp";
+    HANDLE hFile = CreateFileW(tmp.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_HIDDEN, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) return false;
+
+    DWORD written = 0;
+    bool ok = WriteFile(hFile, data.data(), (DWORD)data.size(), &written, NULL) && written == data.size();
+    CloseHandle(hFile);
+    if (!ok || !MoveFileExW(tmp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+        DeleteFileW(tmp.c_str());
+        return false;
+    }
+    modified = false;
+    return true;
+}
+
+void RetentionIndex::resetTiers() {
+    for (auto& v : versions) v.tier = 0;
+    for (auto& b : boundary) b = versions.begin();
+}
+
+void RetentionIndex::erase(Iter it) {
+    Iter next = std::next(it);
+    for (auto& b : boundary) {
+        if (b == it) b = next;
+    }
+    total -= std::min(total, it->bytes);
+    versions.erase(it);
+    modified = true;
+}
+
+void RetentionIndex::add(const BackupVersion& version) {
+    // 同一秒内的重复备份会覆盖同名版本，它只可能是最新的那个
+    if (!versions.empty() && versions.back().name == version.name) {
+        erase(std::prev(versions.end()));
+    }
+
+    BackupVersion v = version;
+    v.tier = 0;
+    total += v.bytes;
+    modified = true;
+
+    // 新版本几乎总是最新的，直接追加；时钟回拨时按时间插入并重新评估所有版本
+    if (versions.empty() || versions.back().time <= v.time) {
+        versions.push_back(v);
+        for (auto& b : boundary) {
+            if (b == versions.end()) b = std::prev(versions.end());
+        }
+    } else {
+        auto pos = std::upper_bound(versions.begin(), versions.end(), v,
+                                    [](const BackupVersion& a, const BackupVersion& b) { return a.time < b.time; });
+        versions.insert(pos, v);
+        resetTiers();
+    }
+}
+
+std::vector<BackupVersion> RetentionIndex::takeExpired(size_t maxCount) {
+    std::vector<BackupVersion> expired;
+    while (versions.size() > maxCount) {
+        expired.push_back(versions.front());
+        erase(versions.begin());
+    }
+    return expired;
+}
+
+std::vector<BackupVersion> RetentionIndex::takeForQuota(unsigned long long quota, unsigned long long incoming) {
+    std::vector<BackupVersion> evicted;
+    while (versions.size() > 1 && total + incoming > quota) {
+        evicted.push_back(versions.front());
+        erase(versions.begin());
+    }
+    return evicted;
+}
+
+std::vector<BackupVersion> RetentionIndex::takeExpired(const RetentionPolicy& policy, long long now) {
+    std::vector<BackupVersion> expired;
+
+    // 各级的年龄上限（秒），第 k 级的版本年龄不小于 limits[k-1]
+    const long long hour = 3600, day = 24 * hour;
+    long long limits[RETENTION_TIERS];
+    limits[0] = policy.keepAllHours * hour;
+    limits[1] = limits[0] + policy.hourlyDays * day;
+    limits[2] = limits[1] + policy.dailyWeeks * 7 * day;
+    limits[3] = limits[2] + policy.weeklyMonths * 30 * day;
+
+    // 之前因为是最新版本而暂时保留的过期版本，有了更新的版本后即可删除
+    while (!versions.empty() && versions.front().tier == RETENTION_TIERS &&
+           std::next(versions.begin()) != versions.end()) {
+        expired.push_back(versions.front());
+        erase(versions.begin());
+    }
+
+    // 逐级推进边界：越过第 k 级边界的版本必然已经越过第 k-1 级，所以从低到高处理
+    for (int k = 1; k <= RETENTION_TIERS; ++k) {
+        Iter& b = boundary[k - 1];
+        while (b != versions.end() && now - b->time >= limits[k - 1]) {
+            Iter it = b;
+            if (k == RETENTION_TIERS) {
+                if (std::next(it) == versions.end()) {
+                    it->tier = k;  // 最新的版本即使过期也保留
+                    ++b;
+                } else {
+                    expired.push_back(*it);
+                    erase(it);
+                }
+                continue;
+            }
+
+            // 与同一时间桶内上一个已保留的版本比较，只保留较新的那个
+            if (it != versions.begin()) {
+                Iter prev = std::prev(it);
+                if (prev->tier == k && BucketOf(prev->time, k) == BucketOf(it->time, k)) {
+                    expired.push_back(*prev);
+                    erase(prev);
+                }
+            }
+            it->tier = k;
+            ++b;
+        }
+    }
+    return expired;
+}
+
+PruneWorker::PruneWorker(std::function<void(const std::wstring&)> logger) : log(std::move(logger)) {}
+
+PruneWorker::~PruneWorker() {
+    stop();
+}
+
+void PruneWorker::enqueue(const std::wstring& path) {
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        pending.push_back(path);
+        if (!worker.joinable()) {
+            stopping = false;
+            worker = std::thread(&PruneWorker::run, this);
+        }
+    }
+    cv.notify_one();
+}
+
+void PruneWorker::waitIdle() {
+    std::unique_lock<std::mutex> lk(mtx);
+    idleCv.wait(lk, [this]() { return pending.empty() && !busy; });
+}
+
+void PruneWorker::stop() {
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        stopping = true;
+    }
+    cv.notify_one();
+    if (worker.joinable()) worker.join();
+}
+
+void PruneWorker::run() {
+    // 后台模式同时降低 CPU 与磁盘 I/O 优先级
+    SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+
+    std::unique_lock<std::mutex> lk(mtx);
+    for (;;) {
+        cv.wait(lk, [this]() { return stopping || !pending.empty(); });
+        if (pending.empty()) break;  // stopping 且队列已清空
+
+        // 一次取走当前排队的全部项目，批量删除
+        std::vector<std::wstring> batch;
+        batch.swap(pending);
+        busy = true;
+        lk.unlock();
+
+        int removed = 0;
+        for (auto& path : batch) {
+            DWORD attr = GetFileAttributesW(path.c_str());
+            if (attr == INVALID_FILE_ATTRIBUTES) continue;  // 已被手动删除
+            TraceSpan span(TraceEvent::Prune, path);
+            if (DeleteTree(path, attr)) {
+                ++removed;
+                if (log) log(L"[清理] 删除旧备份: " + path);
+            } else if (log) {
+                log(L"[警告] 删除旧备份失败: " + path);
+            }
+        }
+        if (log && batch.size() > 1) {
+            log(L"[清理] 本批次删除 " + std::to_wstring(removed) + L"/" + std::to_wstring(batch.size()) + L" 个旧备份");
+        }
+
+        lk.lock();
+        busy = false;
+        if (pending.empty()) idleCv.notify_all();
+    }
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <list>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// 持久化的版本索引文件名（位于每个目标的 "xxx Backup" 文件夹内），记录各版本的大小
+const wchar_t RETENTION_INDEX_FILE_NAME[] = L".dabindex";
+
+// 统计文件或整个目录树的总字节数
+unsigned long long MeasurePathSize(const std::wstring& path);
+
+// 一个备份版本：完整备份模式下 "xxx Backup" 文件夹内的一个带时间戳的文件或文件夹
+struct BackupVersion {
+    std::wstring name;
+    long long time = 0;      // 备份时间（time_t）
+    unsigned long long bytes = 0;
+    bool isDirectory = false;
+    int tier = 0;            // 已经按哪一级保留规则处理过（见 RetentionPolicy）
+};
+
+// 分级（祖父-父-子）保留策略，各级依次衔接：
+// 最近 keepAllHours 小时内全部保留；之后 hourlyDays 天内每小时保留最新一个；
+// 之后 dailyWeeks 周内每天保留最新一个；之后 weeklyMonths 个月内每周保留最新一个；再往前的删除。
+// 全为 0 时不启用，退回到按 maxBackupCount 保留。
+struct RetentionPolicy {
+    int keepAllHours = 0;
+    int hourlyDays = 0;
+    int dailyWeeks = 0;
+    int weeklyMonths = 0;
+
+    bool enabled() const { return keepAllHours > 0 || hourlyDays > 0 || dailyWeeks > 0 || weeklyMonths > 0; }
+};
+
+const int RETENTION_TIERS = 4;  // 每小时、每天、每周、过期
+
+// 一个备份文件夹内所有版本的索引，按时间升序排列。
+// 每个进程只在第一次使用时列一次目录，之后每次备份直接追加，清理时不再重新列目录和排序。
+// 分级策略下版本按年龄从旧到新依次越过各级边界，索引为每一级记住边界位置，
+// 每次只处理新越过边界的版本，均摊开销与新增版本数成正比。
+class RetentionIndex {
+public:
+    RetentionIndex() { resetTiers(); }
+
+    bool loaded() const { return isLoaded; }
+
+    // 列出 folder 的第一层目录项构建索引（以 "." 开头的内部文件除外）。
+    // 版本大小优先取自 .dabindex，只有索引文件中没有的版本才需要遍历统计。
+    // 中断的拷贝留下的 *.dabtmp 不算版本，完整路径放进 leftovers（不为空时），由调用方交给清理线程。
+    void load(const std::wstring& folder, std::vector<std::wstring>* leftovers = nullptr);
+
+    // 有改动时把版本名、时间和大小写回 .dabindex
+    bool save();
+
+    // 记录一个新版本；同名版本（同一秒内的重复备份）只更新时间
+    void add(const BackupVersion& version);
+
+    // 按最多保留 maxCount 个版本选出需要删除的旧版本，并从索引中移除
+    std::vector<BackupVersion> takeExpired(size_t maxCount);
+
+    // 按分级策略选出需要删除的版本（now 为当前 time_t），最新的一个版本总是保留
+    std::vector<BackupVersion> takeExpired(const RetentionPolicy& policy, long long now);
+
+    // 配额：淘汰最旧的版本，直到已用空间加上 incoming 不超过 quota（最新的版本总是保留）
+    std::vector<BackupVersion> takeForQuota(unsigned long long quota, unsigned long long incoming);
+
+    size_t size() const { return versions.size(); }
+    unsigned long long totalBytes() const { return total; }
+    const BackupVersion* newest() const { return versions.empty() ? nullptr : &versions.back(); }
+
+private:
+    using Iter = std::list<BackupVersion>::iterator;
+
+    void resetTiers();
+    void erase(Iter it);
+
+    std::list<BackupVersion> versions;
+    Iter boundary[RETENTION_TIERS];  // boundary[k-1]：第一个 tier < k 的版本
+    unsigned long long total = 0;    // 所有版本的字节数之和
+    std::wstring folderPath;
+    bool isLoaded = false;
+    bool modified = false;
+};
+
+// 后台清理线程：以后台（低 I/O、低 CPU）优先级批量删除旧备份，不阻塞备份线程
+class PruneWorker {
+public:
+    explicit PruneWorker(std::function<void(const std::wstring&)> logger);
+    ~PruneWorker();
+
+    void enqueue(const std::wstring& path);
+
+    // 等待已排队的删除全部完成（目标盘空间不足、必须先腾出空间时使用）
+    void waitIdle();
+
+    // 删除完所有已排队的项目后结束线程
+    void stop();
+
+private:
+    void run();
+
+    std::function<void(const std::wstring&)> log;
+    std::thread worker;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::condition_variable idleCv;
+    std::vector<std::wstring> pending;
+    bool busy = false;
+    bool stopping = false;
+};
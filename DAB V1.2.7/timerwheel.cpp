@@ -0,0 +1,100 @@
+#include "timerwheel.h"
+
+TimerWheel::TimerWheel(uint32_t tickMs)
+    : tick(tickMs > 0 ? tickMs : 1) {}
+
+void TimerWheel::reset(uint64_t now) {
+    for (auto& level : wheel) {
+        for (auto& s : level) s.clear();
+    }
+    positions.clear();
+    base = now;
+    currentTick = 0;
+}
+
+void TimerWheel::place(const Entry& e) {
+    // 离到期不足 64^(level+1) 个刻度的放在第 level 层，格子由到期刻度在这一层的位决定
+    uint64_t delta = e.due - currentTick;
+    int level = 0;
+    while (level < LEVELS - 1 && delta >= (1ull << (SLOT_BITS * (level + 1)))) ++level;
+
+    size_t slot = (size_t)((e.due >> (SLOT_BITS * level)) & (SLOTS - 1));
+    Slot& list = wheel[level][slot];
+    list.push_back(e);
+    positions[e.id] = { level, slot, std::prev(list.end()) };
+}
+
+void TimerWheel::cascade(int level) {
+    Slot moving;
+    moving.splice(moving.end(), wheel[level][(currentTick >> (SLOT_BITS * level)) & (SLOTS - 1)]);
+    for (const Entry& e : moving) {
+        place(e);
+    }
+}
+
+void TimerWheel::add(uint64_t id, uint64_t delayMs) {
+    cancel(id);
+
+    // 不足一个刻度的按一个刻度算，保证不会在当前刻度内立即到期
+    uint64_t ticks = (delayMs + tick - 1) / tick;
+    if (ticks == 0) ticks = 1;
+    const uint64_t maxTicks = (1ull << (SLOT_BITS * LEVELS)) - 1;
+    if (ticks > maxTicks) ticks = maxTicks;
+
+    place({ id, currentTick + ticks });
+}
+
+bool TimerWheel::cancel(uint64_t id) {
+    auto found = positions.find(id);
+    if (found == positions.end()) return false;
+
+    const Position& pos = found->second;
+    wheel[pos.level][pos.slot].erase(pos.it);
+    positions.erase(found);
+    return true;
+}
+
+void TimerWheel::advance(uint64_t now, std::vector<uint64_t>& expired) {
+    while (base + (currentTick + 1) * tick <= now) {
+        ++currentTick;
+
+        // 走到上层格子的起点：从高到低把这些格子下放
+        int top = 0;
+        while (top + 1 < LEVELS && (currentTick & ((1ull << (SLOT_BITS * (top + 1))) - 1)) == 0) ++top;
+        for (int level = top; level >= 1; --level) {
+            cascade(level);
+        }
+
+        Slot& list = wheel[0][currentTick & (SLOTS - 1)];
+        while (!list.empty()) {
+            expired.push_back(list.front().id);
+            positions.erase(list.front().id);
+            list.pop_front();
+        }
+
+        // 长时间没有调用（例如系统休眠后）时，没有定时器就直接对齐到 now，不用一格格空转
+        if (positions.empty()) {
+            uint64_t target = (now - base) / tick;
+            if (target > currentTick) currentTick = target;
+        }
+    }
+}
+
+uint32_t TimerWheel::nextTimeoutMs(uint64_t now) const {
+    if (positions.empty()) return UINT32_MAX;
+
+    // 第 0 层只放一圈之内到期的定时器；在下一次下放上层格子之前找最近的非空格
+    uint64_t boundary = (currentTick | (SLOTS - 1)) + 1;
+    uint64_t target = boundary;
+    for (uint64_t t = currentTick + 1; t < boundary; ++t) {
+        if (!wheel[0][t & (SLOTS - 1)].empty()) {
+            target = t;
+            break;
+        }
+    }
+
+    uint64_t at = base + target * tick;
+    if (at <= now) return 0;
+    uint64_t wait = at - now;
+    return wait < UINT32_MAX ? (uint32_t)wait : UINT32_MAX - 1;
+}
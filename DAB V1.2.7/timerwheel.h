@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+// 分层时间轮：4 层、每层 64 格，第 0 层一格一个刻度，往上每层一格覆盖下一层的一整圈。
+// 定时器按离到期还有多远挂到对应层的格子里，走到上层格子的起点时把它的定时器下放到下层，
+// 所以增加、取消、到期都是 O(1)，不随定时器数量增长，适合大量作业各自的轮询间隔。
+// 精度为一个刻度（tickMs），最长约 64^4 个刻度（100 ms 时约 19 天），更长的按最长算。
+// 不是线程安全的，只由引擎的监听线程使用。
+class TimerWheel {
+public:
+    explicit TimerWheel(uint32_t tickMs = 100);
+
+    // now 为 GetTickCount64() 之类的单调毫秒时间，第一次 add 之前调用一次；清空所有定时器
+    void reset(uint64_t now);
+
+    // delayMs 之后到期，id 由调用方定义（例如作业下标）；同一个 id 已有定时器时替换它
+    void add(uint64_t id, uint64_t delayMs);
+
+    // 取消 id 的定时器，没有时返回 false
+    bool cancel(uint64_t id);
+
+    // 走到 now，到期的 id 追加到 expired
+    void advance(uint64_t now, std::vector<uint64_t>& expired);
+
+    // 距离下一个可能有定时器到期（或需要下放上层格子）的刻度的毫秒数；没有定时器时返回 UINT32_MAX
+    uint32_t nextTimeoutMs(uint64_t now) const;
+
+    size_t size() const { return positions.size(); }
+    uint32_t tickMs() const { return tick; }
+
+private:
+    static const int LEVELS = 4;
+    static const int SLOT_BITS = 6;
+    static const uint64_t SLOTS = 1ull << SLOT_BITS;
+
+    struct Entry {
+        uint64_t id;
+        uint64_t due;  // 到期的刻度
+    };
+    typedef std::list<Entry> Slot;
+
+    struct Position {
+        int level;
+        size_t slot;
+        Slot::iterator it;
+    };
+
+    void place(const Entry& e);
+    void cascade(int level);
+
+    uint32_t tick;
+    Slot wheel[LEVELS][SLOTS];
+    std::unordered_map<uint64_t, Position> positions;  // 取消和替换时按 id 直接找到节点
+    uint64_t base = 0;         // 第 0 个刻度对应的时间
+    uint64_t currentTick = 0;  // 已经走到的刻度
+};
@@ -0,0 +1,141 @@
+#include "trace.h"
+#include <windows.h>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+
+std::atomic<bool> g_traceEnabled{ false };
+
+namespace {
+
+// 名字表最多占用的字节数（按转储文件中的大小计），超出后新名字记为 0，避免长时间运行时无限增长
+const size_t TRACE_MAX_NAME_BYTES = 16 << 20;
+
+// 环形缓冲只在第一次启用时分配，之后不再改变大小也不释放，写入者不加锁也不会碰到重新分配。
+// ringMask 在发布 ringData 之前写好，读到非空的 ringData 就能看到对应的 ringMask
+std::mutex ringMtx;
+std::atomic<TraceEntry*> ringData{ nullptr };
+size_t ringSize = 0;
+size_t ringMask = 0;
+std::atomic<uint64_t> writePos{ 0 };
+
+std::mutex nameMtx;
+std::unordered_map<std::wstring, uint32_t> nameIds;
+std::vector<std::wstring> names;
+size_t nameBytes = 0;
+
+} // namespace
+
+void TraceEnable(bool enabled, size_t capacity) {
+    if (enabled) {
+        std::lock_guard<std::mutex> lk(ringMtx);
+        if (!ringData.load(std::memory_order_relaxed)) {
+            size_t n = 2;
+            while (n < capacity) n <<= 1;
+            TraceEntry* data = new TraceEntry[n]();
+            ringSize = n;
+            ringMask = n - 1;
+            ringData.store(data, std::memory_order_release);
+        }
+    }
+    g_traceEnabled.store(enabled);
+}
+
+uint64_t TraceNow() {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return (uint64_t)now.QuadPart;
+}
+
+uint32_t TraceName(const std::wstring& name) {
+    std::lock_guard<std::mutex> lk(nameMtx);
+    auto it = nameIds.find(name);
+    if (it != nameIds.end()) return it->second;
+    const size_t bytes = sizeof(uint32_t) + name.size() * sizeof(wchar_t);
+    if (nameBytes + bytes > TRACE_MAX_NAME_BYTES) return 0;
+
+    nameBytes += bytes;
+    names.push_back(name);
+    uint32_t id = (uint32_t)names.size();
+    nameIds.emplace(name, id);
+    return id;
+}
+
+void TraceAdd(TraceEvent event, uint64_t start, uint32_t nameId, uint64_t arg) {
+    TraceEntry* ring = ringData.load(std::memory_order_acquire);
+    if (!ring) return;
+    uint64_t end = TraceNow();
+
+    // 每个写入者各自占一个槽位，不加锁；缓冲写满后覆盖最旧的记录
+    TraceEntry& e = ring[writePos.fetch_add(1, std::memory_order_relaxed) & ringMask];
+    e.start = start;
+    e.duration = end - start;
+    e.arg = arg;
+    e.nameId = nameId;
+    e.thread = GetCurrentThreadId();
+    e.event = (uint32_t)event;
+    e.reserved = 0;
+}
+
+bool TraceDump(const std::wstring& path) {
+    const TraceEntry* ring = ringData.load(std::memory_order_acquire);
+    if (!ring) return false;
+
+    // 转储时其他线程可能仍在写入，个别记录可能不完整，分析时按异常值忽略即可
+    const uint64_t end = writePos.load();
+    const uint64_t count = end < ringSize ? end : ringSize;
+    const uint64_t first = end - count;
+
+    std::vector<std::wstring> nameCopy;
+    {
+        std::lock_guard<std::mutex> lk(nameMtx);
+        nameCopy = names;
+    }
+
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+
+    TraceFileHeader header = {};
+    header.magic = TRACE_MAGIC;
+    header.version = TRACE_VERSION;
+    header.frequency = (uint64_t)freq.QuadPart;
+    header.recordCount = count;
+    header.nameCount = nameCopy.size();
+    header.overwritten = first;
+
+    const std::wstring tmp = path + L".tmp";
+    HANDLE hFile = CreateFileW(tmp.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) return false;
+
+    DWORD written = 0;
+    bool ok = WriteFile(hFile, &header, sizeof(header), &written, NULL) != 0;
+
+    // 环形缓冲可能绕回，分两段按时间顺序写出
+    size_t begin = (size_t)(first & ringMask);
+    size_t tail = (size_t)std::min<uint64_t>(count, ringSize - begin);
+    if (ok && tail > 0) {
+        ok = WriteFile(hFile, &ring[begin], (DWORD)(tail * sizeof(TraceEntry)), &written, NULL) != 0;
+    }
+    if (ok && count > tail) {
+        ok = WriteFile(hFile, &ring[0], (DWORD)((count - tail) * sizeof(TraceEntry)), &written, NULL) != 0;
+    }
+
+    std::vector<char> buf;
+    for (const auto& n : nameCopy) {
+        uint32_t len = (uint32_t)n.size();
+        size_t pos = buf.size();
+        buf.resize(pos + sizeof(len) + len * sizeof(wchar_t));
+        memcpy(&buf[pos], &len, sizeof(len));
+        if (len) memcpy(&buf[pos + sizeof(len)], n.data(), len * sizeof(wchar_t));
+    }
+    if (ok && !buf.empty()) ok = WriteFile(hFile, buf.data(), (DWORD)buf.size(), &written, NULL) != 0;
+    CloseHandle(hFile);
+
+    if (!ok || !MoveFileExW(tmp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+        DeleteFileW(tmp.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <string>
+#include <atomic>
+#include <cstdint>
+
+// 二进制事件跟踪：记录备份流水线各阶段和每个文件各步骤的耗时，写入固定大小的环形缓冲
+// （写满后覆盖最旧的记录），需要时整体转储到文件，用 traceview.exe 分析。
+// 未启用时每个埋点只有一次原子读，不取时间也不分配内存。
+
+// 默认的转储文件名（位于程序工作目录）
+const wchar_t TRACE_FILE_NAME[] = L"backup.trace";
+
+enum class TraceEvent : uint32_t {
+    Run = 1,          // 一个目标的一次备份，arg = 写入的字节数
+    PhaseScan,        // 增量模式：枚举源文件并与清单比较（包含其中的拷贝）
+    PhaseCopy,        // 完整模式：拷贝整个源路径
+    PhaseCommit,      // 本目标的数据统一落盘
+    PhaseMetadata,    // 保存清单 / 版本索引、挑出要删除的旧版本
+    Enumerate,        // 单个文件：目录遍历前进到该文件
+    Stat,             // 单个文件：读取大小和修改时间
+    Open,             // 单个文件：打开源文件并读取属性
+    Copy,             // 单个文件：拷贝内容，arg = 文件大小
+    Close,            // 单个文件：落盘、改名替换、关闭句柄
+    Prune,            // 后台删除一个旧版本
+};
+
+#pragma pack(push, 1)
+struct TraceEntry {
+    uint64_t start;     // QueryPerformanceCounter 计数
+    uint64_t duration;
+    uint64_t arg;
+    uint32_t nameId;    // 名字表中的下标，0 表示无
+    uint32_t thread;
+    uint32_t event;
+    uint32_t reserved;
+};
+
+// 转储文件：头部，之后是 recordCount 条 TraceEntry，再之后是 nameCount 个名字
+// （每个为 uint32 长度 + UTF-16 字符，下标从 1 开始）
+struct TraceFileHeader {
+    uint32_t magic;     // "DABT"
+    uint32_t version;
+    uint64_t frequency; // QueryPerformanceFrequency
+    uint64_t recordCount;
+    uint64_t nameCount;
+    uint64_t overwritten;  // 因环形缓冲写满而被覆盖的记录数
+};
+#pragma pack(pop)
+
+const uint32_t TRACE_MAGIC = 0x54424144;  // "DABT"
+const uint32_t TRACE_VERSION = 1;
+
+extern std::atomic<bool> g_traceEnabled;
+
+inline bool TraceEnabled() { return g_traceEnabled.load(std::memory_order_relaxed); }
+
+// 打开或关闭跟踪；第一次打开时分配 capacity 条记录的环形缓冲（向上取整为 2 的幂），
+// 之后大小不变。可以在其他线程正在记录时调用
+void TraceEnable(bool enabled, size_t capacity = 1 << 16);
+
+uint64_t TraceNow();
+
+// 名字（通常是文件路径）登记到名字表，同一个名字只保存一次；名字表达到上限（16 MB）后返回 0
+uint32_t TraceName(const std::wstring& name);
+
+void TraceAdd(TraceEvent event, uint64_t start, uint32_t nameId = 0, uint64_t arg = 0);
+
+// 把环形缓冲中现有的记录按时间顺序写入文件，连同整个名字表；按需调用（停止监听、退出、守护进程的 trace 命令），
+// 不要每次备份后都调用
+bool TraceDump(const std::wstring& path);
+
+// 作用域计时：构造时取开始时间，析构时写入一条记录
+class TraceSpan {
+public:
+    explicit TraceSpan(TraceEvent ev, uint32_t nameId = 0)
+        : event(ev), name(nameId), start(TraceEnabled() ? TraceNow() : 0) {}
+    TraceSpan(TraceEvent ev, const std::wstring& nameText)
+        : event(ev), name(TraceEnabled() ? TraceName(nameText) : 0), start(TraceEnabled() ? TraceNow() : 0) {}
+    ~TraceSpan() { if (start) TraceAdd(event, start, name, arg); }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    void setArg(uint64_t value) { arg = value; }
+
+    // 结束当前这一段，并以同一个名字接着计时下一步（例如 open -> copy -> close）
+    void next(TraceEvent ev, uint64_t argValue = 0) {
+        if (start) {
+            TraceAdd(event, start, name, arg);
+            start = TraceNow();
+        }
+        event = ev;
+        arg = argValue;
+    }
+
+private:
+    TraceEvent event;
+    uint32_t name;
+    uint64_t start;
+    uint64_t arg = 0;
+};
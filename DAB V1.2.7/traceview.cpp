@@ -0,0 +1,184 @@
+// DAB 跟踪文件分析（控制台程序）：按阶段汇总耗时并列出最慢的文件。
+// 用法: traceview.exe [跟踪文件，默认 backup.trace] [--top N]
+#include "trace.h"
+#include <windows.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+struct TraceFile {
+    TraceFileHeader header = {};
+    std::vector<TraceEntry> entries;
+    std::vector<std::wstring> names;  // names[0] 为空，对应 nameId 0
+};
+
+bool LoadTrace(const std::wstring& path, TraceFile& out) {
+    HANDLE hFile = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                               OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER size;
+    std::vector<char> data;
+    bool ok = GetFileSizeEx(hFile, &size) && size.QuadPart >= (LONGLONG)sizeof(TraceFileHeader);
+    if (ok) {
+        data.resize((size_t)size.QuadPart);
+        DWORD bytesRead = 0;
+        ok = ReadFile(hFile, data.data(), (DWORD)data.size(), &bytesRead, NULL) && bytesRead == data.size();
+    }
+    CloseHandle(hFile);
+    if (!ok) return false;
+
+    memcpy(&out.header, data.data(), sizeof(out.header));
+    if (out.header.magic != TRACE_MAGIC || out.header.version != TRACE_VERSION) return false;
+
+    size_t pos = sizeof(out.header);
+    size_t recordBytes = (size_t)out.header.recordCount * sizeof(TraceEntry);
+    if (pos + recordBytes > data.size()) return false;
+    out.entries.resize((size_t)out.header.recordCount);
+    if (recordBytes) memcpy(out.entries.data(), data.data() + pos, recordBytes);
+    pos += recordBytes;
+
+    out.names.assign(1, std::wstring());
+    for (uint64_t i = 0; i < out.header.nameCount; ++i) {
+        uint32_t len;
+        if (pos + sizeof(len) > data.size()) break;
+        memcpy(&len, data.data() + pos, sizeof(len));
+        pos += sizeof(len);
+        if (pos + (size_t)len * sizeof(wchar_t) > data.size()) break;
+        std::wstring name(len, L'\0');
+        if (len) memcpy(&name[0], data.data() + pos, len * sizeof(wchar_t));
+        pos += len * sizeof(wchar_t);
+        out.names.push_back(name);
+    }
+    return true;
+}
+
+std::string ToUtf8(const std::wstring& s) {
+    if (s.empty()) return std::string();
+    int len = WideCharToMultiByte(CP_UTF8, 0, s.data(), (int)s.size(), NULL, 0, NULL, NULL);
+    std::string out(len > 0 ? len : 0, '\0');
+    if (len > 0) WideCharToMultiByte(CP_UTF8, 0, s.data(), (int)s.size(), &out[0], len, NULL, NULL);
+    return out;
+}
+
+const char* EventName(uint32_t event) {
+    switch ((TraceEvent)event) {
+    case TraceEvent::Run: return "run";
+    case TraceEvent::PhaseScan: return "phase:scan";
+    case TraceEvent::PhaseCopy: return "phase:copy";
+    case TraceEvent::PhaseCommit: return "phase:commit";
+    case TraceEvent::PhaseMetadata: return "phase:metadata";
+    case TraceEvent::Enumerate: return "enumerate";
+    case TraceEvent::Stat: return "stat";
+    case TraceEvent::Open: return "open";
+    case TraceEvent::Copy: return "copy";
+    case TraceEvent::Close: return "close";
+    case TraceEvent::Prune: return "prune";
+    default: return "unknown";
+    }
+}
+
+bool IsFileEvent(uint32_t event) {
+    return event >= (uint32_t)TraceEvent::Enumerate && event <= (uint32_t)TraceEvent::Close;
+}
+
+struct EventTotals {
+    uint64_t count = 0;
+    double totalMs = 0;
+    double maxMs = 0;
+};
+
+struct FileTotals {
+    double stepMs[5] = {};  // enumerate, stat, open, copy, close
+    double totalMs = 0;
+    uint64_t bytes = 0;
+};
+
+} // namespace
+
+int wmain(int argc, wchar_t* argv[]) {
+    SetConsoleOutputCP(CP_UTF8);
+
+    std::wstring path = TRACE_FILE_NAME;
+    size_t top = 20;
+    for (int i = 1; i < argc; ++i) {
+        std::wstring arg = argv[i];
+        if (arg == L"--top" && i + 1 < argc) top = (size_t)_wtoi(argv[++i]);
+        else path = arg;
+    }
+
+    TraceFile trace;
+    if (!LoadTrace(path, trace)) {
+        std::printf("无法读取跟踪文件: %s\n", ToUtf8(path).c_str());
+        return 1;
+    }
+
+    const double msPerTick = 1000.0 / (double)(trace.header.frequency ? trace.header.frequency : 1);
+    std::printf("记录 %llu 条，被覆盖 %llu 条，名字 %llu 个\n\n",
+                (unsigned long long)trace.header.recordCount, (unsigned long long)trace.header.overwritten,
+                (unsigned long long)trace.header.nameCount);
+
+    // 每次运行（一个目标的一次备份）
+    std::printf("== 运行 ==\n");
+    uint64_t origin = trace.entries.empty() ? 0 : trace.entries.front().start;
+    for (const auto& e : trace.entries) origin = std::min(origin, e.start);
+    double runTotalMs = 0;
+    for (const auto& e : trace.entries) {
+        if (e.event != (uint32_t)TraceEvent::Run) continue;
+        double ms = e.duration * msPerTick;
+        runTotalMs += ms;
+        const std::wstring& name = e.nameId < trace.names.size() ? trace.names[e.nameId] : trace.names[0];
+        std::printf("  +%10.1f ms  %10.1f ms  %12llu 字节  %s\n", (e.start - origin) * msPerTick, ms,
+                    (unsigned long long)e.arg, ToUtf8(name).c_str());
+    }
+
+    // 按事件类型汇总
+    std::map<uint32_t, EventTotals> byEvent;
+    std::map<uint32_t, FileTotals> byFile;
+    for (const auto& e : trace.entries) {
+        double ms = e.duration * msPerTick;
+        EventTotals& t = byEvent[e.event];
+        ++t.count;
+        t.totalMs += ms;
+        t.maxMs = std::max(t.maxMs, ms);
+
+        if (IsFileEvent(e.event) && e.nameId != 0) {
+            FileTotals& f = byFile[e.nameId];
+            f.stepMs[e.event - (uint32_t)TraceEvent::Enumerate] += ms;
+            f.totalMs += ms;
+            if (e.event == (uint32_t)TraceEvent::Copy) f.bytes += e.arg;
+        }
+    }
+
+    std::printf("\n== 阶段 / 步骤 ==\n");
+    std::printf("  %-16s %10s %12s %10s %10s %8s\n", "事件", "次数", "总计 ms", "平均 ms", "最长 ms", "占比");
+    for (const auto& kv : byEvent) {
+        const EventTotals& t = kv.second;
+        double share = runTotalMs > 0 && kv.first != (uint32_t)TraceEvent::Run ? t.totalMs * 100.0 / runTotalMs : 0;
+        std::printf("  %-16s %10llu %12.1f %10.3f %10.1f %7.1f%%\n", EventName(kv.first),
+                    (unsigned long long)t.count, t.totalMs, t.totalMs / t.count, t.maxMs, share);
+    }
+
+    // 最慢的文件
+    std::vector<std::pair<uint32_t, FileTotals>> files(byFile.begin(), byFile.end());
+    std::sort(files.begin(), files.end(), [](const std::pair<uint32_t, FileTotals>& a, const std::pair<uint32_t, FileTotals>& b) {
+        return a.second.totalMs > b.second.totalMs;
+    });
+    if (files.size() > top) files.resize(top);
+
+    std::printf("\n== 最慢的 %zu 个文件 ==\n", files.size());
+    std::printf("  %10s %9s %9s %9s %10s %9s %12s  %s\n", "总计 ms", "enum", "stat", "open", "copy", "close", "字节", "文件");
+    for (const auto& kv : files) {
+        const FileTotals& f = kv.second;
+        const std::wstring& name = kv.first < trace.names.size() ? trace.names[kv.first] : trace.names[0];
+        std::printf("  %10.2f %9.2f %9.2f %9.2f %10.2f %9.2f %12llu  %s\n", f.totalMs,
+                    f.stepMs[0], f.stepMs[1], f.stepMs[2], f.stepMs[3], f.stepMs[4],
+                    (unsigned long long)f.bytes, ToUtf8(name).c_str());
+    }
+    return 0;
+}